@@ -0,0 +1,69 @@
+#include "AllocationCounter.h"
+
+#ifndef NDEBUG
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocationCount{ 0 };
+static thread_local uint32_t uncountedDepth = 0;
+
+//The array and nothrow forms fall back on this one, so it is the only one replaced. Over-aligned
+//allocations keep the standard library's own pair and aren't counted
+void* operator new(size_t size)
+{
+	if(uncountedDepth == 0)
+	{
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void* pointer = std::malloc(size > 0 ? size : 1);
+	if(pointer == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	std::free(pointer);
+}
+
+uint64_t heapAllocationCount()
+{
+	return allocationCount.load(std::memory_order_relaxed);
+}
+
+UncountedAllocations::UncountedAllocations()
+{
+	uncountedDepth++;
+}
+
+UncountedAllocations::~UncountedAllocations()
+{
+	uncountedDepth--;
+}
+
+#else
+
+uint64_t heapAllocationCount()
+{
+	return 0;
+}
+
+UncountedAllocations::UncountedAllocations()
+{
+}
+
+UncountedAllocations::~UncountedAllocations()
+{
+}
+
+#endif
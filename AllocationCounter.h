@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+//Debug builds replace the global operator new to count heap allocations across every thread, so steady state
+//code can check that it never reaches the heap. Release builds leave operator new alone and always read zero
+uint64_t heapAllocationCount();
+
+//Stops counting on this thread while alive. Drivers and layers can allocate inside vk* calls through the
+//same operator new, and those allocations aren't ours to budget
+class UncountedAllocations
+{
+public:
+	UncountedAllocations();
+	~UncountedAllocations();
+
+	UncountedAllocations(const UncountedAllocations&) = delete;
+	UncountedAllocations& operator=(const UncountedAllocations&) = delete;
+};
@@ -1,7 +1,9 @@
 #include "Application.h"
+#include "AllocationCounter.h"
 
 #include <algorithm>
-#include <fstream>
+#include <cassert>
+#include <cmath>
 #include <iostream>
 #include <set>
 #include <stdexcept>
@@ -9,28 +11,25 @@
 #include <vector>
 #include <GLFW/glfw3.h>
 
+//Simulated entirely on the GPU, the CPU only seeds them once
+static constexpr uint32_t PARTICLE_COUNT = 1 << 20;
+
 void Application::run()
 {
 	initializeVulkan();
 	mainLoop();
-	dispose();
 }
 
-static std::vector<char> readFile(const std::string& filename)
+Application::~Application()
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-	if(!file.is_open())
+	//A compile still running in the background would outlive the pipelines it writes to
+	waitForDeferredPipelines();
+
+	//Members free themselves in declaration order, none of them may still be in use by then
+	if(device)
 	{
-		throw std::runtime_error("Unable to open file: " + filename);
+		vkDeviceWaitIdle(device);
 	}
-
-	size_t fileSize = (size_t)file.tellg();
-
-	std::vector<char> buffer(fileSize);
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
-	return buffer;
 }
 
 static bool validationLayersFound(const std::vector<const char*>& layers)
@@ -94,19 +93,6 @@ VkSurfaceFormatKHR Application::chooseSurfaceFormat(const std::vector<VkSurfaceF
 	return formats[0];
 }
 
-VkPresentModeKHR Application::choosePresentMode(const std::vector<VkPresentModeKHR>& modes)
-{
-	for(const auto& mode : modes)
-	{
-		if(mode == VK_PRESENT_MODE_MAILBOX_KHR) // Enable triple-buffering if it supports it
-		{
-			return mode;
-		}
-	}
-
-	return VK_PRESENT_MODE_FIFO_KHR; // Otherwise enable v-sync
-}
-
 VkExtent2D Application::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
 {
 	if(capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
@@ -115,7 +101,7 @@ VkExtent2D Application::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabil
 	}
 
 	int width, height;
-	glfwGetFramebufferSize(window, &width, &height);
+	glfwGetFramebufferSize(window.get(), &width, &height);
 
 	VkExtent2D extent = {
 		static_cast<uint32_t>(width),
@@ -128,6 +114,205 @@ VkExtent2D Application::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabil
 	return extent;
 }
 
+void Application::buildDrawList()
+{
+	const auto& objects = scene.getObjects();
+
+	drawList.clear(&frameArena);
+	drawList.reserve(scene.getVisibleObjects().size());
+	for(uint32_t index : scene.getVisibleObjects())
+	{
+		const SceneObject& object = objects[index];
+		drawList.add(object.pipeline, object.material, object.mesh, object.depth, index);
+	}
+
+	drawList.sort(jobs);
+	drawList.build();
+}
+
+void Application::updateWindowTitle()
+{
+	framesThisSecond++;
+
+	double now = glfwGetTime();
+	if(now - lastTitleUpdate < 1.0)
+	{
+		return;
+	}
+
+	const DrawStats& stats = drawList.getStats();
+	std::string title = "Vulkan window - " + std::to_string(framesThisSecond) + " fps, "
+		+ std::to_string(stats.pipelineBinds) + " pipeline binds, "
+		+ std::to_string(stats.descriptorBinds) + " descriptor binds, "
+		+ std::to_string(stats.draws) + " draws, "
+		+ std::to_string(meshlets.getStats().trianglesDrawn) + "/" + std::to_string(meshlets.getSourceTriangles()) + " triangles, "
+		+ std::to_string(viewCount) + " views, "
+		+ std::to_string(static_cast<int>(meshlets.getOccludedFraction() * 100.0f)) + "% occluded";
+	glfwSetWindowTitle(window.get(), title.c_str());
+
+	framesThisSecond = 0;
+	lastTitleUpdate = now;
+}
+
+void Application::updateViews(double time)
+{
+	//As square a grid as the count allows, the last row may be short
+	uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(viewCount))));
+	uint32_t rows = (viewCount + columns - 1) / columns;
+	uint32_t cellWidth = std::max(swapChainExtent.width / columns, 1u);
+	uint32_t cellHeight = std::max(swapChainExtent.height / rows, 1u);
+
+	//Orbit the knot while drifting in and out, so the LOD cut keeps changing. The views are spread evenly
+	//around the orbit and alternate above and below it
+	float orbit = static_cast<float>(time) * 0.2f;
+	float distance = 3.0f + 2.0f * std::sin(static_cast<float>(time) * 0.15f);
+	for(uint32_t i = 0; i < viewCount; i++)
+	{
+		float angle = orbit + 6.2831853f * static_cast<float>(i) / static_cast<float>(viewCount);
+		float height = (i % 2 == 0 ? 0.5f : -0.5f) * distance;
+		glm::vec3 eye(std::cos(angle) * distance, std::sin(angle) * distance, height);
+
+		RenderView& view = views[i];
+		view.camera = Camera::lookAt(eye, glm::vec3(0.0f), 1.0472f,
+			static_cast<float>(cellWidth), static_cast<float>(cellHeight), 0.01f, 100.0f);
+
+		view.scissor.offset = { static_cast<int32_t>(cellWidth * (i % columns)), static_cast<int32_t>(cellHeight * (i / columns)) };
+		view.scissor.extent = { cellWidth, cellHeight };
+
+		view.viewport.x = static_cast<float>(view.scissor.offset.x);
+		view.viewport.y = static_cast<float>(view.scissor.offset.y);
+		view.viewport.width = static_cast<float>(cellWidth);
+		view.viewport.height = static_cast<float>(cellHeight);
+		view.viewport.minDepth = 0.0f;
+		view.viewport.maxDepth = 1.0f;
+	}
+}
+
+void Application::transitionSwapChainImage(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkImageLayout oldLayout, VkImageLayout newLayout,
+	VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = swapChainImages[imageIndex];
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void Application::beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawPhase phase)
+{
+	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
+	VkClearValue clearDepth{};
+	clearDepth.depthStencil = { 1.0f, 0 };
+	bool early = phase == DrawPhase::Early;
+
+	if(!useDynamicRendering)
+	{
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = early ? renderPass : resumeRenderPass;
+		renderPassBeginInfo.framebuffer = swapChainFrameBuffers[imageIndex];
+		renderPassBeginInfo.renderArea.offset = { 0, 0 };
+		renderPassBeginInfo.renderArea.extent = swapChainExtent;
+		VkClearValue clearValues[] = { clearColor, clearDepth };
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		return;
+	}
+
+	//What the render pass did for us: layout transition, same dependency as the old subpass dependency.
+	//The late half picks up what the early half wrote
+	if(early)
+	{
+		transitionSwapChainImage(commandBuffer, imageIndex, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	}
+	else
+	{
+		transitionSwapChainImage(commandBuffer, imageIndex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	}
+
+	//Last frame's depth tests have to finish before the clear, the early half's before the late half loads it
+	VkImageMemoryBarrier depthBarrier{};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = early ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthImage.image;
+	depthBarrier.subresourceRange.aspectMask = depthAspects(depthFormat);
+	depthBarrier.subresourceRange.levelCount = 1;
+	depthBarrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+
+	VkRenderingAttachmentInfo colorAttachment{};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView = swapChainImageViews[imageIndex];
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	colorAttachment.loadOp = early ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.clearValue = clearColor;
+
+	//The early half's depth is what the pyramid is built from
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView = depthImage.view;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	depthAttachment.loadOp = early ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = early ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.clearValue = clearDepth;
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.renderArea.offset = { 0, 0 };
+	renderingInfo.renderArea.extent = swapChainExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void Application::endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawPhase phase)
+{
+	if(!useDynamicRendering)
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		return;
+	}
+
+	vkCmdEndRendering(commandBuffer);
+
+	if(phase == DrawPhase::Late)
+	{
+		transitionSwapChainImage(commandBuffer, imageIndex, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+	}
+}
+
 void Application::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 {
 	VkCommandBufferBeginInfo beginInfo{};
@@ -140,20 +325,39 @@ void Application::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
 		throw std::runtime_error("Failed to start recording command buffer!");
 	}
 
-	VkRenderPassBeginInfo renderPassBeginInfo{};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = renderPass;
-	renderPassBeginInfo.framebuffer = swapChainFrameBuffers[imageIndex];
-	renderPassBeginInfo.renderArea.offset = { 0, 0 };
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;
-	VkClearValue clearColor = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-	renderPassBeginInfo.clearValueCount = 1;
-	renderPassBeginInfo.pClearValues = &clearColor;
+	//Without a separate compute queue the simulation step runs here, before the pass that draws it
+	if(deferredPipelinesReady && !particles.isAsync())
+	{
+		particles.recordUpdate(commandBuffer, frameDeltaTime);
+	}
+
+	//Two-phase occlusion culling: clusters visible last frame are drawn first, the depth pyramid built from
+	//them decides which of the rest still need drawing. Both halves of the pass run either way
+	if(deferredPipelinesReady)
+	{
+		meshlets.recordEarlyCull(commandBuffer, currentFrame, views, viewCount);
+	}
+
+	beginRendering(commandBuffer, imageIndex, DrawPhase::Early);
+	if(deferredPipelinesReady)
+	{
+		meshlets.recordDraw(commandBuffer, currentFrame, views, viewCount, DrawPhase::Early);
+	}
+	endRendering(commandBuffer, imageIndex, DrawPhase::Early);
+
+	if(deferredPipelinesReady)
+	{
+		meshlets.recordLateCull(commandBuffer, currentFrame, views, viewCount);
+	}
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	//Depth tested geometry first, the 2D layers draw over it. The views leave their own viewports behind
+	beginRendering(commandBuffer, imageIndex, DrawPhase::Late);
+	if(deferredPipelinesReady)
+	{
+		meshlets.recordDraw(commandBuffer, currentFrame, views, viewCount, DrawPhase::Late);
+	}
 
-	//Set dynamic viewport and scissor
+	//Set dynamic viewport and scissor, the sprites and particles cover the whole window
 	VkViewport viewport;
 	viewport.x = 0.0f;
 	viewport.y = 0.0f;
@@ -168,149 +372,146 @@ void Application::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
 	scissor.extent = swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-
-	vkCmdEndRenderPass(commandBuffer);
+	//Each frame in flight owns a slice of the instance buffer
+	VkDeviceSize instanceOffset = sizeof(InstanceData) * scene.getObjects().size() * currentFrame;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, instanceBuffer.buffer.address(), &instanceOffset);
 
-	if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	//The draw list already worked out which binds are redundant
+	const auto& materials = scene.getMaterials();
+	const auto& meshes = scene.getMeshes();
+	for(const DrawBatch& batch : drawList.getBatches())
 	{
-		throw std::runtime_error("Failed to end command buffer!");
-	}
-}
-
-void Application::initializeVulkan()
-{
-	glfwInit();
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-
-	window = glfwCreateWindow(800, 600, "Vulkan window", nullptr, nullptr);
+		if(batch.bindPipeline)
+		{
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[batch.pipeline]);
+		}
 
-	const std::vector<const char*> validationLayers = {
-		"VK_LAYER_KHRONOS_validation"
-	};
+		if(batch.bindMaterial)
+		{
+			MaterialPushConstants pushConstants{};
+			pushConstants.tint = materials[batch.material].tint;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+		}
 
-	if(!validationLayersFound(validationLayers))
-	{
-		throw std::runtime_error("Validation layer not found!");
+		const Mesh& mesh = meshes[batch.mesh];
+		vkCmdDraw(commandBuffer, mesh.vertexCount, batch.instanceCount, mesh.firstVertex, batch.firstInstance);
 	}
 
-	// Create instance
-	VkApplicationInfo appInfo{};
-	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	appInfo.apiVersion = VK_API_VERSION_1_0;
-	appInfo.pApplicationName = "Hello, Vulkan!";
-	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.pEngineName = "Josh Engine";
-	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-
-	VkInstanceCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	createInfo.pApplicationInfo = &appInfo;
-
-	uint32_t glfwExtensionCount;
-	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-	extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-	//extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-
-	//Enable extensions required for GLFW
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
-	createInfo.ppEnabledExtensionNames = extensions.data();
-
-	//Enable debug validation layers
-	createInfo.ppEnabledLayerNames = validationLayers.data();
-	createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-
-	if(vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Unable to create Vulkan instance");
-	} else
+	if(deferredPipelinesReady)
 	{
-		std::cout << "Created Vulkan instance" << std::endl;
+		particles.recordDraw(commandBuffer);
 	}
 
-	//Use the first physical device
-	uint32_t deviceCount;
-	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
-	std::vector<VkPhysicalDevice> devices(deviceCount);
-	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
-	if(deviceCount == 0)
+	endRendering(commandBuffer, imageIndex, DrawPhase::Late);
+
+	if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
-		throw std::runtime_error("No compatible devices found!");
+		throw std::runtime_error("Failed to end command buffer!");
 	}
+}
 
-	physicalDevice = devices[0];
-
-	VkPhysicalDeviceProperties deviceProperties;
-	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
-
-	std::cout << "Using device 0: " << deviceProperties.deviceName << std::endl;
-	std::cout << "Discrete? " << (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? "Yes" : "No") << std::endl;
+void Application::createRenderPass()
+{
+	//Create the render pass
+	//Use a single color buffer from the swap chain
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = swapChainFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
-	//Create window surface
-	if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to create Vulkan window surface");
-	}
+	//Disregard the stencil buffer
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-	//Find the queue families
-	queueIndices = QueueFamilyIndices::find(physicalDevice, surface);
+	//Stays an attachment, resumeRenderPass carries on drawing into it
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	//Depth is only needed within the frame, but the pyramid is built from it between the two passes
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = depthFormat;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-	swapChainDetails = SwapChainSupportDetails::find(physicalDevice, surface);
-	if(!swapChainDetails.isSuitable())
-	{
-		throw std::runtime_error("Invalid swapchain");
-	}
+	//Color subpass
+	VkAttachmentReference colorAttachmentRef{};
+	colorAttachmentRef.attachment = 0;
+	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<uint32_t> uniqueQueueFamilies = { queueIndices.graphicsFamily.value(), queueIndices.presentFamily.value() };
-	float queuePriority = 1.0f;
+	VkAttachmentReference depthAttachmentRef{};
+	depthAttachmentRef.attachment = 1;
+	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-	for (uint32_t queueFamily : uniqueQueueFamilies)
-	{
-		VkDeviceQueueCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		createInfo.queueFamilyIndex = queueFamily;
-		createInfo.queueCount = 1;
-		createInfo.pQueuePriorities = &queuePriority;
+	//Create subpass
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-		queueCreateInfos.push_back(createInfo);
-	}
+	//Create render pass
+	VkRenderPassCreateInfo renderPassInfo{};
 
-	VkPhysicalDeviceFeatures deviceFeatures{}; // Not using anything special
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-	std::vector<const char*> deviceExtensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
-	};
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
 
-	VkDeviceCreateInfo deviceInfo{};
-	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
-	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-	deviceInfo.pEnabledFeatures = &deviceFeatures;
-	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	VkAttachmentDescription attachments[] = { colorAttachment, depthAttachment };
+	renderPassInfo.attachmentCount = 2;
+	renderPassInfo.pAttachments = attachments;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
 
-	if(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &device) != VK_SUCCESS)
+	if(vkCreateRenderPass(device, &renderPassInfo, nullptr, renderPass.put(device)) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create logical device!");
+		throw std::runtime_error("Failed to create render pass!");
 	}
 
-	if(!queueIndices.isSuitable())
+	//Same attachments loaded back, after the early half or the depth pyramid build
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	VkAttachmentDescription resumeAttachments[] = { colorAttachment, depthAttachment };
+	renderPassInfo.pAttachments = resumeAttachments;
+
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+		| VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		| VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	if(vkCreateRenderPass(device, &renderPassInfo, nullptr, resumeRenderPass.put(device)) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Device cannot present!");
+		throw std::runtime_error("Failed to create resume render pass!");
 	}
+}
 
-	vkGetDeviceQueue(device, queueIndices.presentFamily.value(), 0, &presentQueue);
-	vkGetDeviceQueue(device, queueIndices.graphicsFamily.value(), 0, &graphicsQueue);
-
+void Application::createSwapChain(VkSwapchainKHR oldSwapchain)
+{
 	//Create swap-chain
 	VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat(swapChainDetails.formats);
 	swapChainFormat = surfaceFormat.format;
-	VkPresentModeKHR presentMode = choosePresentMode(swapChainDetails.presentModes);
+	VkPresentModeKHR presentMode = pacer.choosePresentMode(swapChainDetails.presentModes);
 	swapChainExtent = chooseSwapExtent(swapChainDetails.capabilities);
-	uint32_t imageCount = swapChainDetails.capabilities.minImageCount + 1;
+	uint32_t imageCount = pacer.swapChainImageCount(swapChainDetails.capabilities);
 
 	VkSwapchainCreateInfoKHR swapchainCreateInfo{};
 	swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -339,9 +540,9 @@ void Application::initializeVulkan()
 	swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	swapchainCreateInfo.presentMode = presentMode;
 	swapchainCreateInfo.clipped = VK_TRUE;
-	swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
-	if(vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapchain) != VK_SUCCESS)
+	if(vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, swapchain.put(device)) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Error creating swapchain!");
 	}
@@ -374,342 +575,844 @@ void Application::initializeVulkan()
 		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
 		imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-		if(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
+		if(vkCreateImageView(device, &imageViewCreateInfo, nullptr, swapChainImageViews[i].put(device)) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Couldn't create image view!");
 		}
 	}
+}
 
-	//Load shaders
-	auto fragShaderSource = readFile("frag.spv");
-	auto vertShaderSource = readFile("vert.spv");
-
-	std::cout << "Frag length: " << fragShaderSource.size() << ", Vert length: " << vertShaderSource.size() << std::endl;
+void Application::createDepthResources()
+{
+	//Sampled by the depth pyramid build, the view only covers the depth aspect so it can be
+	depthImage = createImage(physicalDevice, device, swapChainExtent, depthFormat,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
 
-	//Load frag
-	VkShaderModuleCreateInfo fragInfo{};
-	fragInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	fragInfo.codeSize = fragShaderSource.size();
-	fragInfo.pCode = reinterpret_cast<const uint32_t*>(fragShaderSource.data());
-	VkShaderModule fragModule;
-	if(vkCreateShaderModule(device, &fragInfo, nullptr, &fragModule) != VK_SUCCESS)
+void Application::createFrameBuffers()
+{
+	//Dynamic rendering attaches the image views directly
+	if(useDynamicRendering)
 	{
-		throw std::runtime_error("Failed to create fragment shader!");
+		return;
 	}
 
-	//Load vert
-	VkShaderModuleCreateInfo vertInfo{};
-	vertInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	vertInfo.codeSize = vertShaderSource.size();
-	vertInfo.pCode = reinterpret_cast<const uint32_t*>(vertShaderSource.data());
-	VkShaderModule vertModule;
-	if (vkCreateShaderModule(device, &vertInfo, nullptr, &vertModule) != VK_SUCCESS)
+	//Initalize framebuffers
+	swapChainFrameBuffers.resize(swapChainImageViews.size());
+	for(size_t i = 0; i < swapChainImageViews.size(); i++)
 	{
-		throw std::runtime_error("Failed to create vertex shader!");
-	}
+		VkImageView attachments[] = {
+			swapChainImageViews[i],
+			depthImage.view
+		};
 
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.module = vertModule;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.pName = "main";
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = renderPass;
+		framebufferInfo.attachmentCount = 2;
+		framebufferInfo.pAttachments = attachments;
+		framebufferInfo.width = swapChainExtent.width;
+		framebufferInfo.height = swapChainExtent.height;
+		framebufferInfo.layers = 1;
 
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.module = fragModule;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.pName = "main";
+		if(vkCreateFramebuffer(device, &framebufferInfo, nullptr, swapChainFrameBuffers[i].put(device)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create framebuffer " + std::to_string(i));
+		}
+	}
+}
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+void Application::retireSwapChain()
+{
+	//The last submitted frame may still be rendering to or presenting any of these
+	deletionQueue.retire(frameNumber, std::move(swapChainFrameBuffers));
+	deletionQueue.retire(frameNumber, std::move(swapChainImageViews));
+	deletionQueue.retire(frameNumber, std::move(depthImage));
+	deletionQueue.retire(frameNumber, std::move(swapchain));
+
+	swapChainFrameBuffers.clear();
+	swapChainImageViews.clear();
+	swapChainImages.clear();
+}
 
-	//Enable dynamic viewport size and scissor states
-	std::vector<VkDynamicState> dynamicStates = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-	VkPipelineDynamicStateCreateInfo dynamicState{};
-	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	dynamicState.pDynamicStates = dynamicStates.data();
-
-	//Describes the vertex input into the vertex shader
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr;
-
-	//Pass in vertices as triangle lists
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	//Make the viewport cover the entire screen
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+void Application::recreateSwapChain()
+{
+	//No idle wait, the old objects stay alive in the deletion queue until their frames are done
+	VkSwapchainKHR oldSwapchain = swapchain;
+	retireSwapChain();
 
-	//Render the entire screen
-	VkRect2D scissor{};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
+	//The surface may have changed size or lost a present mode since last time
+	swapChainDetails = SwapChainSupportDetails::find(physicalDevice, surface);
+	createSwapChain(oldSwapchain);
+	createDepthResources();
+	createFrameBuffers();
 
+	deletionQueue.retire(frameNumber, meshlets.setDepthTarget(depthImage.image, depthImage.view, swapChainExtent));
+}
 
-	VkPipelineViewportStateCreateInfo viewportState{};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	//Initialize rasterization pipeline
-	VkPipelineRasterizationStateCreateInfo rasterizer{};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE; // Clockwise ordering, opposite of OpenGL
-
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f;
-	rasterizer.depthBiasClamp = 0.0f;
-	rasterizer.depthBiasSlopeFactor = 0.0f;
-
-	//Disable multisampling
-	VkPipelineMultisampleStateCreateInfo multisampling{};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-	//Color blending settings for the frame buffer
-	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-	//Global color blending settings
-	VkPipelineColorBlendStateCreateInfo colorBlending{};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
+//Startup jobs write into initializeVulkan's locals. Whichever way it's left, nothing may still be running
+//once they go out of scope, so whatever the normal path didn't wait on is waited on here
+class StartupJobs
+{
+private:
+	JobSystem& jobs;
+	std::vector<Job*> pending;
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pSetLayouts = nullptr;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+public:
+	explicit StartupJobs(JobSystem& jobs) : jobs(jobs) {}
 
-	//Create the pipeline layout
-	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+	~StartupJobs()
 	{
-		throw std::runtime_error("Failed to create pipeline layout");
+		//Only reached with jobs left when an exception is already on its way out, that one wins
+		for(Job* job : pending)
+		{
+			try
+			{
+				jobs.wait(job);
+			} catch(...)
+			{
+			}
+		}
 	}
 
-	//Create the render pass
-	//Use a single color buffer from the swap chain
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = swapChainFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	StartupJobs(const StartupJobs&) = delete;
+	StartupJobs& operator=(const StartupJobs&) = delete;
 
-	//Disregard the stencil buffer
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	void run(Job* job)
+	{
+		pending.push_back(job);
+		jobs.run(job);
+	}
 
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	//Rethrows like JobSystem::wait. The job is forgotten first, a finished job's slot may be reused
+	void wait(Job* job)
+	{
+		pending.erase(std::remove(pending.begin(), pending.end(), job), pending.end());
+		jobs.wait(job);
+	}
+};
 
-	//Color subpass
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+void Application::initializeVulkan()
+{
+	//Startup runs as a graph on the job system: file reads start right away, the sprite pipelines compile
+	//alongside swapchain creation, and the particle and meshlet pipelines only have to be in after the first frame
+	startup.restart();
 
-	//Create subpass
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
+	startup.measure("window", [this]()
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+		window.reset(glfwCreateWindow(800, 600, "Vulkan window", nullptr, nullptr));
+		glfwSetWindowUserPointer(window.get(), this);
+		glfwSetKeyCallback(window.get(), keyCallback);
+	});
+
+	//Everything the jobs write to is declared before the guard, so it is destroyed after the guard has waited
+	std::vector<char> fragShaderSource;
+	std::vector<char> vertShaderSource;
+	MeshletMesh meshletMesh;
+	StartupJobs startupJobs(jobs);
+
+	//Read the shaders on the workers while the instance, device and swapchain get created
+	Job* loadShaders = jobs.createJob(nullptr);
+	jobs.run(jobs.createChildJob(loadShaders, [this, &fragShaderSource]()
+	{
+		startup.measure("read frag.spv", [&]() { fragShaderSource = readFile("frag.spv"); });
+	}));
+	jobs.run(jobs.createChildJob(loadShaders, [this, &vertShaderSource]()
+	{
+		startup.measure("read vert.spv", [&]() { vertShaderSource = readFile("vert.spv"); });
+	}));
+	startupJobs.run(loadShaders);
 
-	//Create render pass
-	VkRenderPassCreateInfo renderPassInfo{};
+	//The cluster hierarchy is cached on disk, building it takes seconds
+	Job* loadMeshlets = jobs.createJob([this, &meshletMesh]()
+	{
+		startup.measure("meshlet mesh", [&]()
+		{
+			if(!loadMeshletMesh(DEMO_MESHLET_FILE, meshletMesh))
+			{
+				meshletMesh = buildDemoMeshletMesh(jobs);
+
+				//The cache only saves the next start some time, the mesh in memory is all this one needs
+				if(!saveMeshletMesh(DEMO_MESHLET_FILE, meshletMesh))
+				{
+					std::cout << "Warning: unable to write " << DEMO_MESHLET_FILE << ", the meshlet mesh is rebuilt on every start" << std::endl;
+				}
+			}
+		});
+	});
+	startupJobs.run(loadMeshlets);
 
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	startup.measure("instance", [this]() { createInstance(); });
+	startup.measure("device", [this]() { createDevice(); });
 
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	//Both formats are known before the swapchain exists, which is all the pipelines need from it
+	swapChainFormat = chooseSurfaceFormat(swapChainDetails.formats).format;
+	depthFormat = findDepthFormat(physicalDevice);
+	if(!useDynamicRendering)
+	{
+		createRenderPass();
+	}
 
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
+	//The library gets its own copy of the format, createSwapChain() writes the member while the worker compiles
+	PipelineLibraryInfo libraryInfo{};
+	libraryInfo.device = device;
+	libraryInfo.renderPass = renderPass;
+	libraryInfo.colorFormat = swapChainFormat;
+	libraryInfo.depthFormat = depthFormat;
+	pipelineLibrary.initialize(libraryInfo);
 
-	if(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+	Job* spritePipelines = jobs.createJob([this, loadShaders, &fragShaderSource, &vertShaderSource]()
 	{
-		throw std::runtime_error("Failed to create render pass!");
+		jobs.wait(loadShaders);
+		startup.measure("sprite pipelines", [&]() { createSpritePipelines(vertShaderSource, fragShaderSource); });
+	});
+	startupJobs.run(spritePipelines);
+
+	startup.measure("swapchain", [this]()
+	{
+		createSwapChain();
+		createDepthResources();
+		createFrameBuffers();
+	});
+
+	startup.measure("frame resources", [this]()
+	{
+		//Create command pool
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		poolInfo.queueFamilyIndex = queueIndices.graphicsFamily.value();
+
+		if(vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.put(device)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create command pool!");
+		}
+
+		//Create instance buffer, host visible so the draw list can be written straight into it
+		instanceBuffer = createBuffer(physicalDevice, device, sizeof(InstanceData) * scene.getObjects().size() * FramePacer::MAX_FRAMES_IN_FLIGHT,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		instanceData = static_cast<InstanceData*>(instanceBuffer.mapped);
+
+		//One command buffer and set of sync objects per frame in flight
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		//Create synchronization objects
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Act as if the previous frame is finished on the first frame
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		for (auto& frame : frames)
+		{
+			if(vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create command buffer!");
+			}
+
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, frame.imageAvailableSemaphore.put(device)) != VK_SUCCESS ||
+				vkCreateSemaphore(device, &semaphoreInfo, nullptr, frame.renderFinishedSemaphore.put(device)) != VK_SUCCESS ||
+				vkCreateFence(device, &fenceInfo, nullptr, frame.inFlightFence.put(device)) != VK_SUCCESS) {
+				throw std::runtime_error("Failed to create semaphores!");
+			}
+		}
+	});
+
+	ParticleSystemInfo particleInfo{};
+	particleInfo.physicalDevice = physicalDevice;
+	particleInfo.device = device;
+	particleInfo.graphicsFamily = queueIndices.graphicsFamily.value();
+	particleInfo.computeFamily = queueIndices.computeFamily.value();
+	particleInfo.computeQueue = computeQueue;
+	particleInfo.framesInFlight = FramePacer::MAX_FRAMES_IN_FLIGHT;
+	startup.measure("particle upload", [&]() { particles.initialize(particleInfo, PARTICLE_COUNT); });
+
+	MeshletRendererInfo meshletInfo{};
+	meshletInfo.physicalDevice = physicalDevice;
+	meshletInfo.device = device;
+	meshletInfo.queue = graphicsQueue;
+	meshletInfo.commandPool = commandPool;
+	meshletInfo.depthFormat = depthFormat;
+	meshletInfo.framesInFlight = FramePacer::MAX_FRAMES_IN_FLIGHT;
+	meshletInfo.multiDrawIndirect = multiDrawIndirect;
+	meshletInfo.multiViewport = multiViewport;
+
+	startupJobs.wait(loadMeshlets);
+	startup.measure("meshlet upload", [&]() { meshlets.initialize(meshletInfo, meshletMesh); });
+	meshlets.setDepthTarget(depthImage.image, depthImage.view, swapChainExtent);
+
+	//The first frame only draws sprites
+	startupJobs.wait(loadShaders);
+	startupJobs.wait(spritePipelines);
+
+	//Particles and meshlets are switched on by drawFrame once these are in
+	deferredPipelinesDone.store(false);
+	deferredPipelinesError = nullptr;
+	deferredPipelinesReady = false;
+	deferredPipelines = std::thread(&Application::compileDeferredPipelines, this);
+
+	startup.record("initializeVulkan", 0.0, startup.now());
+}
+
+void Application::createInstance()
+{
+	const std::vector<const char*> validationLayers = {
+		"VK_LAYER_KHRONOS_validation"
+	};
+
+	if(!validationLayersFound(validationLayers))
+	{
+		throw std::runtime_error("Validation layer not found!");
 	}
 
-	//Create graphics pipeline(finally)
-	VkGraphicsPipelineCreateInfo pipelineInfo{};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	// Create instance
+	VkApplicationInfo appInfo{};
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.apiVersion = VK_API_VERSION_1_0;
 
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
+	//Ask for 1.3 when the loader has it, dynamic rendering is core there
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	vkEnumerateInstanceVersion(&loaderVersion);
+	if(loaderVersion >= VK_API_VERSION_1_3)
+	{
+		appInfo.apiVersion = VK_API_VERSION_1_3;
+	}
+	appInfo.pApplicationName = "Hello, Vulkan!";
+	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+	appInfo.pEngineName = "Josh Engine";
+	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+
+	VkInstanceCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	createInfo.pApplicationInfo = &appInfo;
+
+	uint32_t glfwExtensionCount;
+	const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	//extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = &dynamicState;
-	pipelineInfo.layout = pipelineLayout;
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0;
+	//Enable extensions required for GLFW
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-	pipelineInfo.basePipelineIndex = -1;
+	//Enable debug validation layers
+	createInfo.ppEnabledLayerNames = validationLayers.data();
+	createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 
-	if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+	if(vkCreateInstance(&createInfo, nullptr, instance.put()) != VK_SUCCESS)
 	{
-		throw std::runtime_error("Failed to create graphics pipeline");
+		throw std::runtime_error("Unable to create Vulkan instance");
+	} else
+	{
+		std::cout << "Created Vulkan instance" << std::endl;
 	}
 
-	//Initalize framebuffers
-	swapChainFrameBuffers.resize(swapChainImageViews.size());
-	for(size_t i = 0; i < swapChainImageViews.size(); i++)
+	//Route validation messages through debugCallback
+	VkDebugUtilsMessengerCreateInfoEXT messengerInfo{};
+	messengerInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	messengerInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	messengerInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messengerInfo.pfnUserCallback = debugCallback;
+
+	if(CreateDebugUtilsMessengerEXT(instance, &messengerInfo, nullptr, debugMessenger.put(instance)) != VK_SUCCESS)
 	{
-		VkImageView attachments[] = {
-			swapChainImageViews[i]
-		};
+		throw std::runtime_error("Failed to set up debug messenger!");
+	}
 
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
-		framebufferInfo.width = swapChainExtent.width;
-		framebufferInfo.height = swapChainExtent.height;
-		framebufferInfo.layers = 1;
+	//Use the first physical device
+	uint32_t deviceCount;
+	vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+	std::vector<VkPhysicalDevice> devices(deviceCount);
+	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+	if(deviceCount == 0)
+	{
+		throw std::runtime_error("No compatible devices found!");
+	}
+
+	physicalDevice = devices[0];
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	std::cout << "Using device 0: " << deviceProperties.deviceName << std::endl;
+	std::cout << "Discrete? " << (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? "Yes" : "No") << std::endl;
+
+	//Prefer dynamic rendering, no render pass or framebuffers to build
+	useDynamicRendering = false;
+	if(renderPath != RenderPath::RenderPass && appInfo.apiVersion >= VK_API_VERSION_1_3 && deviceProperties.apiVersion >= VK_API_VERSION_1_3)
+	{
+		VkPhysicalDeviceVulkan13Features supported13{};
+		supported13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+		VkPhysicalDeviceFeatures2 supported{};
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported.pNext = &supported13;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+		useDynamicRendering = supported13.dynamicRendering == VK_TRUE;
+	}
 
-		if(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFrameBuffers[i]) != VK_SUCCESS)
+	if(renderPath == RenderPath::DynamicRendering && !useDynamicRendering)
+	{
+		throw std::runtime_error("Dynamic rendering not supported!");
+	}
+
+	std::cout << "Render path: " << (useDynamicRendering ? "dynamic rendering" : "render pass") << std::endl;
+
+	//Writing gl_ViewportIndex from the vertex shader is core in 1.2. glslang emits it through the
+	//viewport/layer extension, which asks for layer output as well
+	multiViewport = false;
+	if(appInfo.apiVersion >= VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+	{
+		VkPhysicalDeviceVulkan12Features supported12{};
+		supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 supported{};
+		supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported.pNext = &supported12;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+
+		multiViewport = supported.features.multiViewport == VK_TRUE && deviceProperties.limits.maxViewports >= MAX_RENDER_VIEWS
+			&& supported12.shaderOutputViewportIndex == VK_TRUE && supported12.shaderOutputLayer == VK_TRUE;
+	}
+
+	std::cout << "Camera views: " << (multiViewport ? "one pass" : "one pass per view") << std::endl;
+}
+
+void Application::createDevice()
+{
+	//Create window surface
+	if (glfwCreateWindowSurface(instance, window.get(), nullptr, surface.put(instance)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create Vulkan window surface");
+	}
+
+	//Find the queue families
+	queueIndices = QueueFamilyIndices::find(physicalDevice, surface);
+
+	swapChainDetails = SwapChainSupportDetails::find(physicalDevice, surface);
+	if(!swapChainDetails.isSuitable())
+	{
+		throw std::runtime_error("Invalid swapchain");
+	}
+
+	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+	std::set<uint32_t> uniqueQueueFamilies = { queueIndices.graphicsFamily.value(), queueIndices.presentFamily.value(), queueIndices.computeFamily.value() };
+	float queuePriority = 1.0f;
+
+	for (uint32_t queueFamily : uniqueQueueFamilies)
+	{
+		VkDeviceQueueCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		createInfo.queueFamilyIndex = queueFamily;
+		createInfo.queueCount = 1;
+		createInfo.pQueuePriorities = &queuePriority;
+
+		queueCreateInfos.push_back(createInfo);
+	}
+
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+	//Lets all the clusters go out in one indirect draw
+	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	multiDrawIndirect = deviceFeatures.multiDrawIndirect == VK_TRUE;
+
+	//Checked in createInstance
+	deviceFeatures.multiViewport = multiViewport ? VK_TRUE : VK_FALSE;
+
+	VkPhysicalDeviceVulkan13Features features13{};
+	features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	features13.dynamicRendering = VK_TRUE;
+
+	VkPhysicalDeviceVulkan12Features features12{};
+	features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	features12.shaderOutputViewportIndex = VK_TRUE;
+	features12.shaderOutputLayer = VK_TRUE;
+
+	//Only chain what the device is known to have
+	void* featureChain = useDynamicRendering ? &features13 : nullptr;
+	if(multiViewport)
+	{
+		features12.pNext = featureChain;
+		featureChain = &features12;
+	}
+
+	std::vector<const char*> deviceExtensions = {
+		VK_KHR_SWAPCHAIN_EXTENSION_NAME
+	};
+
+	VkDeviceCreateInfo deviceInfo{};
+	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.pNext = featureChain;
+	deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
+	deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
+	deviceInfo.pEnabledFeatures = &deviceFeatures;
+	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+
+	if(vkCreateDevice(physicalDevice, &deviceInfo, nullptr, device.put()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create logical device!");
+	}
+
+	if(!queueIndices.isSuitable())
+	{
+		throw std::runtime_error("Device cannot present!");
+	}
+
+	vkGetDeviceQueue(device, queueIndices.presentFamily.value(), 0, &presentQueue);
+	vkGetDeviceQueue(device, queueIndices.graphicsFamily.value(), 0, &graphicsQueue);
+	vkGetDeviceQueue(device, queueIndices.computeFamily.value(), 0, &computeQueue);
+}
+
+//The manifest of sprite pipeline variants, indexed by PipelineId. A new variant is a new row here,
+//everything else about the pipeline is shared
+struct SpriteVariant
+{
+	BlendMode blend;
+
+	//constant_id 0 in shader.frag
+	uint32_t additive;
+};
+
+static const SpriteVariant SPRITE_VARIANTS[PIPELINE_COUNT] = {
+	{ BlendMode::Opaque, 0 },
+	{ BlendMode::Additive, 1 }
+};
+
+PipelineDesc Application::spritePipelineDesc(PipelineId id) const
+{
+	PipelineDesc desc{};
+	desc.vertexShader = "vert.spv";
+	desc.fragmentShader = "frag.spv";
+	desc.specialization = { SPRITE_VARIANTS[id].additive };
+	desc.layout = pipelineLayout;
+
+	//Vertices come from the shader, only the per-instance transform is read from a buffer.
+	//Offset, scale and rotation packed into one vec4
+	VkVertexInputBindingDescription instanceBinding{};
+	instanceBinding.binding = 0;
+	instanceBinding.stride = sizeof(InstanceData);
+	instanceBinding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	desc.bindings = { instanceBinding };
+
+	VkVertexInputAttributeDescription instanceAttribute{};
+	instanceAttribute.binding = 0;
+	instanceAttribute.location = 0;
+	instanceAttribute.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	instanceAttribute.offset = 0;
+	desc.attributes = { instanceAttribute };
+
+	desc.cullMode = VK_CULL_MODE_BACK_BIT;
+	desc.frontFace = VK_FRONT_FACE_CLOCKWISE; // Clockwise ordering, opposite of OpenGL
+
+	//Sprites go on top of the 3D geometry without touching its depth
+	desc.depthTest = false;
+	desc.depthWrite = false;
+
+	desc.blend = SPRITE_VARIANTS[id].blend;
+	return desc;
+}
+
+void Application::createSpritePipelines(const std::vector<char>& vertShaderSource, const std::vector<char>& fragShaderSource)
+{
+	std::cout << "Frag length: " << fragShaderSource.size() << ", Vert length: " << vertShaderSource.size() << std::endl;
+
+	//Already read on the loader jobs, the library would read them again otherwise
+	pipelineLibrary.addShader("vert.spv", vertShaderSource);
+	pipelineLibrary.addShader("frag.spv", fragShaderSource);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 0;
+	pipelineLayoutInfo.pSetLayouts = nullptr;
+
+	//Material tint
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(MaterialPushConstants);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	//Create the pipeline layout
+	if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, pipelineLayout.put(device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline layout");
+	}
+
+	//All variants compile side by side on the job system, so none of them is first compiled mid-frame
+	std::vector<PipelineDesc> manifest;
+	for(uint32_t id = 0; id < PIPELINE_COUNT; id++)
+	{
+		manifest.push_back(spritePipelineDesc(static_cast<PipelineId>(id)));
+	}
+	pipelineLibrary.precompile(jobs, manifest);
+
+	graphicsPipelines.clear();
+	for(const PipelineDesc& desc : manifest)
+	{
+		graphicsPipelines.push_back(pipelineLibrary.get(desc));
+	}
+}
+
+void Application::compileDeferredPipelines()
+{
+	//Not a worker of the frame job system, which would throw if used in here. Failures are handed to drawFrame
+	try
+	{
+		std::vector<PipelineDesc> manifest;
+		particles.addPipelines(manifest);
+		meshlets.addPipelines(manifest);
+
+		startup.measure("particle and meshlet pipelines", [&]()
 		{
-			throw std::runtime_error("Failed to create framebuffer " + std::to_string(i));
-		}
+			//A pool of its own that only ever runs these compiles, one thread per pipeline at most, so they still
+			//build side by side without a frame's wait() ever picking one up
+			uint32_t workers = std::min(static_cast<uint32_t>(manifest.size()) - 1, JobSystem::defaultWorkerCount());
+			JobSystem compileJobs(workers);
+			pipelineLibrary.precompile(compileJobs, manifest);
+		});
+
+		particles.createPipelines(pipelineLibrary);
+		meshlets.createPipelines(pipelineLibrary);
+	} catch(...)
+	{
+		deferredPipelinesError = std::current_exception();
 	}
 
-	//Create command pool
-	VkCommandPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueIndices.graphicsFamily.value();
+	deferredPipelinesDone.store(true, std::memory_order_release);
+}
+
+void Application::waitForDeferredPipelines()
+{
+	if(deferredPipelines.joinable())
+	{
+		deferredPipelines.join();
+	}
+}
 
-	if(vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+void Application::finishStartup()
+{
+	if(deferredPipelinesError)
 	{
-		throw std::runtime_error("Failed to create command pool!");
+		std::rethrow_exception(deferredPipelinesError);
 	}
 
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = 1;
+	deferredPipelinesReady = true;
+	startup.print(std::cout, "Startup timeline");
+}
 
-	if(vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+void Application::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if(action != GLFW_PRESS)
 	{
-		throw std::runtime_error("Failed to create command buffer!");
+		return;
 	}
 
-	//Create synchronization objects
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // Act as if the previous frame is finished on the first frame
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	//V cycles through one to MAX_RENDER_VIEWS camera views
+	auto app = static_cast<Application*>(glfwGetWindowUserPointer(window));
+	if(key == GLFW_KEY_V)
+	{
+		app->viewCount = app->viewCount % MAX_RENDER_VIEWS + 1;
+		return;
+	}
+
+	//O switches occlusion culling, the exit report compares frame times with and without it
+	if(key == GLFW_KEY_O)
+	{
+		app->meshlets.occlusionCulling = !app->meshlets.occlusionCulling;
+		std::cout << "Occlusion culling: " << (app->meshlets.occlusionCulling ? "on" : "off") << std::endl;
+		return;
+	}
 
-	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS ||
-		vkCreateFence(device, &fenceInfo, nullptr, &inFlightFence) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to create semaphores!");
+	if(key < GLFW_KEY_1 || key >= GLFW_KEY_1 + static_cast<int>(PacingMode::Count))
+	{
+		return;
 	}
 
-	vkDestroyShaderModule(device, fragModule, nullptr);
-	vkDestroyShaderModule(device, vertModule, nullptr);
+	//1, 2 and 3 pick the pacing mode, applied between frames by the main loop
+	app->requestedPacingMode = static_cast<PacingMode>(key - GLFW_KEY_1);
+}
+
+void Application::setPacingMode(PacingMode mode)
+{
+	vkDeviceWaitIdle(device);
+
+	pacer.setMode(mode);
+	currentFrame = 0;
+	std::cout << "Pacing mode: " << FramePacer::modeName(mode) << std::endl;
+
+	//Present mode and image count both depend on the pacing mode
+	recreateSwapChain();
 }
 
 void Application::mainLoop()
 {
-	while (!glfwWindowShouldClose(window)) {
+	while (!glfwWindowShouldClose(window.get())) {
+		pacer.waitForFrameStart();
 		glfwPollEvents();
+
+		if(requestedPacingMode.has_value())
+		{
+			setPacingMode(requestedPacingMode.value());
+			requestedPacingMode.reset();
+		}
+
 		drawFrame();
+		updateWindowTitle();
 	}
+
+	//Closed before the deferred compile finished, the report should count all of it
+	waitForDeferredPipelines();
+
+	pacer.printLatency();
+	meshlets.printOcclusion(std::cout);
+	std::cout << "Pipeline library: " << pipelineLibrary.size() << " pipelines, " << pipelineLibrary.getPrecompiled() << " precompiled, "
+		<< pipelineLibrary.getDuplicates() << " duplicates folded, " << pipelineLibrary.getLateCompiles() << " compiled on first use" << std::endl;
+	std::cout << "Frame arena: " << frameArena.getPeak() << " of " << frameArena.getCapacity() << " bytes at peak" << std::endl;
 }
 
 void Application::drawFrame()
 {
-	//Wait for previous frame
-	vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
-	vkResetFences(device, 1, &inFlightFence);
+	//Nothing from the last frame outlives it, its command buffer was recorded and submitted already
+	frameArena.reset();
+
+	//Past startup a frame runs out of storage reserved up front and the arena, the heap is off limits
+	bool steadyState = deferredPipelinesReady;
+	[[maybe_unused]] uint64_t allocationsAtStart = heapAllocationCount();
+
+	double frameStart = startup.now();
+	double now = glfwGetTime();
+	float deltaTime = lastFrameTime > 0.0 ? static_cast<float>(now - lastFrameTime) : 0.0f;
+	lastFrameTime = now;
+	frameDeltaTime = deltaTime;
+
+	updateViews(now);
+
+	//Scene work doesn't touch the GPU, so start it before blocking on the previous frame
+	Job* updateJob = jobs.createJob([this, deltaTime]() { scene.update(jobs, deltaTime); });
+	Job* cullJob = jobs.createJob([this]() { scene.cull(jobs); });
+	Job* drawListJob = jobs.createJob([this]() { buildDrawList(); });
+	jobs.addDependency(cullJob, updateJob);
+	jobs.addDependency(drawListJob, cullJob);
+	Job* meshletJob = jobs.createJob([this]() { meshlets.select(jobs, views, viewCount); });
+	jobs.run(drawListJob);
+	jobs.run(cullJob);
+	jobs.run(updateJob);
+	jobs.run(meshletJob);
+
+	//Wait for the last frame that used this slot, everything retired up to it can go now
+	//Vulkan calls are left out of the allocation count, layers and drivers may allocate in them
+	FrameData& frame = frames[currentFrame];
+	{
+		UncountedAllocations uncounted;
+		vkWaitForFences(device, 1, frame.inFlightFence.address(), VK_TRUE, UINT64_MAX);
+		deletionQueue.collect(frame.submittedFrame);
+		meshlets.collectResults(currentFrame);
+	}
 
+	pacer.beginAcquire();
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore, inFlightFence, &imageIndex);
+	VkResult acquireResult;
+	{
+		UncountedAllocations uncounted;
+		acquireResult = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	}
+	pacer.endAcquire();
+
+	jobs.wait(drawListJob);
+	jobs.wait(meshletJob);
+
+	if(acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		recreateSwapChain();
+		return;
+	}
+	else if(acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR)
+	{
+		throw std::runtime_error("Failed to acquire swapchain image!");
+	}
+
+	//Only reset once work is certain to be submitted, otherwise the next wait would never return
+	{
+		UncountedAllocations uncounted;
+		vkResetFences(device, 1, frame.inFlightFence.address());
+	}
+
+	//Kick the simulation off first so it overlaps recording, graphics picks it up at vertex input
+	VkSemaphore particlesUpdated = VK_NULL_HANDLE;
+	if(deferredPipelinesReady && particles.isAsync())
+	{
+		UncountedAllocations uncounted;
+		particlesUpdated = particles.submitUpdate(currentFrame, deltaTime);
+	}
+
+	Job* recordJob = jobs.createJob([this, imageIndex]()
+	{
+		//Instances go in sorted order so every batch reads a contiguous range
+		const auto& objects = scene.getObjects();
+		const auto& items = drawList.getItems();
+		InstanceData* frameInstances = instanceData + objects.size() * currentFrame;
+		for(size_t i = 0; i < items.size(); i++)
+		{
+			const SceneObject& object = objects[items[i].objectIndex];
+			frameInstances[i] = { object.position, object.scale, object.rotation };
+		}
+		meshlets.writeDraws(currentFrame, views, viewCount);
 
-	vkResetCommandBuffer(commandBuffer, 0);
-	recordCommandBuffer(commandBuffer, imageIndex);
+		UncountedAllocations uncounted;
+		vkResetCommandBuffer(frames[currentFrame].commandBuffer, 0);
+		recordCommandBuffer(frames[currentFrame].commandBuffer, imageIndex);
+	});
+	jobs.run(recordJob);
+	jobs.wait(recordJob);
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
+	std::pmr::vector<VkSemaphore> waitSemaphores(&frameArena);
+	std::pmr::vector<VkPipelineStageFlags> waitStages(&frameArena);
+	waitSemaphores.push_back(frame.imageAvailableSemaphore);
+	waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	if(particlesUpdated != VK_NULL_HANDLE)
+	{
+		waitSemaphores.push_back(particlesUpdated);
+		waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	}
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
 
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+	VkSemaphore signalSemaphores[] = { frame.renderFinishedSemaphore };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS)
+	VkResult submitResult;
+	{
+		UncountedAllocations uncounted;
+		submitResult = vkQueueSubmit(graphicsQueue, 1, &submitInfo, frame.inFlightFence);
+	}
+
+	if(submitResult != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to submit draw call!");
 	}
+	frame.submittedFrame = ++frameNumber;
 
 	//Present the frame
 	VkPresentInfoKHR presentInfo{};
@@ -723,36 +1426,36 @@ void Application::drawFrame()
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr;
 
-	vkQueuePresentKHR(presentQueue, &presentInfo);
-}
-
-void Application::dispose()
-{
-	glfwDestroyWindow(window);
-	glfwTerminate();
-
-	vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
-	vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-	vkDestroyFence(device, inFlightFence, nullptr);
-
-	vkDestroyCommandPool(device, commandPool, nullptr);
-
-	for (const auto imageView : swapChainImageViews) {
-		vkDestroyImageView(device, imageView, nullptr);
+	VkResult presentResult;
+	{
+		UncountedAllocations uncounted;
+		presentResult = vkQueuePresentKHR(presentQueue, &presentInfo);
 	}
+	pacer.endPresent();
 
-	for (const auto framebuffer : swapChainFrameBuffers) {
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	if(presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+	{
+		recreateSwapChain();
+		steadyState = false;
+	}
+	else if(presentResult != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to present swapchain image!");
 	}
 
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr);
-	vkDestroySwapchainKHR(device, swapchain, nullptr);
-	vkDestroySurfaceKHR(instance, surface, nullptr);
-	vkDestroyInstance(instance, nullptr);
-	vkDestroyDevice(device, nullptr);
-}
+	currentFrame = (currentFrame + 1) % pacer.framesInFlight();
 
+	if(frameNumber == 1)
+	{
+		startup.record("first frame", frameStart, startup.now());
+	}
 
+	assert((!steadyState || (heapAllocationCount() == allocationsAtStart && frameArena.getOverflows() == 0))
+		&& "drawFrame allocated from the heap after startup!");
 
+	//Particles and meshlets join in from the next frame once their pipelines are done
+	if(!deferredPipelinesReady && deferredPipelinesDone.load(std::memory_order_acquire))
+	{
+		finishStartup();
+	}
+}
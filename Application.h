@@ -3,14 +3,35 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <atomic>
+#include <exception>
+#include <memory>
 #include <optional>
+#include <thread>
 #include <vector>
 
+#include "Camera.h"
+#include "DeletionQueue.h"
+#include "DrawList.h"
+#include "FrameArena.h"
+#include "FramePacer.h"
+#include "JobSystem.h"
+#include "MeshletRenderer.h"
+#include "ParticleSystem.h"
+#include "PipelineLibrary.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "VulkanHandle.h"
+#include "VulkanUtil.h"
+
 struct QueueFamilyIndices
 {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	//A compute-only family when the device has one, so the simulation can overlap graphics work
+	std::optional<uint32_t> computeFamily;
+
 	static QueueFamilyIndices find(VkPhysicalDevice device, VkSurfaceKHR surface)
 	{
 		QueueFamilyIndices qf{};
@@ -20,22 +41,24 @@ struct QueueFamilyIndices
 		std::vector<VkQueueFamilyProperties> families(familyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, families.data());
 
+		std::optional<uint32_t> dedicatedCompute;
+
 		int i = 0;
 		for(const auto& family : families)
 		{
-			if(qf.isSuitable())
+			if((family.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !qf.graphicsFamily.has_value())
 			{
-				break;
+				qf.graphicsFamily = i;
 			}
 
-			if(family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if((family.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(family.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !dedicatedCompute.has_value())
 			{
-				qf.graphicsFamily = i;
+				dedicatedCompute = i;
 			}
 
 			VkBool32 presentSupport = false;
 			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-			if (presentSupport)
+			if (presentSupport && !qf.presentFamily.has_value())
 			{
 				qf.presentFamily = i;
 			}
@@ -43,12 +66,22 @@ struct QueueFamilyIndices
 			i++;
 		}
 
+		//Graphics families always support compute, so fall back to sharing the graphics queue
+		if(dedicatedCompute.has_value())
+		{
+			qf.computeFamily = dedicatedCompute;
+		}
+		else
+		{
+			qf.computeFamily = qf.graphicsFamily;
+		}
+
 		return qf;
 	}
 
 	bool isSuitable() const
 	{
-		return graphicsFamily.has_value() && presentFamily.has_value();
+		return graphicsFamily.has_value() && presentFamily.has_value() && computeFamily.has_value();
 	}
 };
 
@@ -93,25 +126,66 @@ struct SwapChainSupportDetails
 	}
 };
 
+enum class RenderPath
+{
+	Auto,            // Dynamic rendering when the device has it, render pass otherwise
+	RenderPass,
+	DynamicRendering
+};
+
+struct FrameData
+{
+	//Freed with the command pool
+	VkCommandBuffer commandBuffer;
+
+	//Why, Vulkan, why?
+	UniqueSemaphore imageAvailableSemaphore;
+	UniqueSemaphore renderFinishedSemaphore;
+	UniqueFence inFlightFence;
+
+	//Number of the last frame submitted with inFlightFence
+	uint64_t submittedFrame = 0;
+};
+
+//The app only ever has the one window, so GLFW goes with it
+struct WindowDeleter
+{
+	void operator()(GLFWwindow* window) const
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+};
+
 class Application
 {
 private:
 
-	VkDebugUtilsMessengerEXT debugMessenger;
+	//Members are destroyed in reverse order: everything made from the device, the device, the surface,
+	//the debug messenger, the instance and finally the window. The destructor waits for the device first
+	std::unique_ptr<GLFWwindow, WindowDeleter> window;
+
+	UniqueInstance instance;
 
-	GLFWwindow* window;
+	UniqueDebugMessenger debugMessenger;
 
-	VkInstance instance;
+	UniqueSurface surface;
 
 	QueueFamilyIndices queueIndices;
 
 	VkPhysicalDevice physicalDevice;
-	VkDevice device;
+	UniqueDevice device;
+	bool multiDrawIndirect = false;
 
-	VkSurfaceKHR surface;
+	//Lets the vertex shader pick the viewport, so every camera view is drawn by the same commands
+	bool multiViewport = false;
+
+	//Resources released mid-run wait here until the frames using them are done
+	DeletionQueue deletionQueue;
 
 	VkQueue presentQueue;
 	VkQueue graphicsQueue;
+	VkQueue computeQueue;
 
 	SwapChainSupportDetails swapChainDetails;
 
@@ -119,38 +193,122 @@ private:
 
 	VkExtent2D swapChainExtent;
 
-	VkSwapchainKHR swapchain;
+	UniqueSwapchain swapchain;
 
+	//Owned by the swapchain
 	std::vector<VkImage> swapChainImages;
 
-	std::vector<VkImageView> swapChainImageViews;
+	std::vector<UniqueImageView> swapChainImageViews;
 
-	std::vector<VkFramebuffer> swapChainFrameBuffers;
+	std::vector<UniqueFramebuffer> swapChainFrameBuffers;
 
-	VkPipelineLayout pipelineLayout;
-	VkRenderPass renderPass;
+	//One depth buffer is enough, frames in flight never rasterize at the same time
+	VkFormat depthFormat;
+	Image depthImage;
 
-	VkPipeline graphicsPipeline;
+	UniquePipelineLayout pipelineLayout;
 
-	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
+	//Only created on the render pass path. renderPass clears and keeps everything for the depth pyramid,
+	//resumeRenderPass loads it back and hands the image to present. Compatible, so pipelines work in both
+	UniqueRenderPass renderPass;
+	UniqueRenderPass resumeRenderPass;
 
-	//Why, Vulkan, why?
-	VkSemaphore imageAvailableSemaphore;
-	VkSemaphore renderFinishedSemaphore;
-	VkFence inFlightFence;
+	RenderPath renderPath = RenderPath::Auto;
+	bool useDynamicRendering = false;
+
+	//Owns every pipeline. The sprite manifest is precompiled during startup, the particle and meshlet one on
+	//the deferred pipeline thread
+	PipelineLibrary pipelineLibrary;
+
+	//Indexed by PipelineId, owned by pipelineLibrary
+	std::vector<VkPipeline> graphicsPipelines;
+
+	//Per-instance transforms in draw list order, mapped for the lifetime of the app
+	Buffer instanceBuffer;
+	InstanceData* instanceData;
+
+	UniqueCommandPool commandPool;
+
+	FrameData frames[FramePacer::MAX_FRAMES_IN_FLIGHT];
+	uint32_t currentFrame = 0;
+
+	//Counts submitted frames, the deletion queue is keyed on it
+	uint64_t frameNumber = 0;
+
+	FramePacer pacer;
+	std::optional<PacingMode> requestedPacingMode;
+
+	JobSystem jobs;
+
+	//Draw lists, submit info and barrier arrays for the frame being built, reset at the top of drawFrame
+	FrameArena frameArena{ 1 << 20 };
+
+	Scene scene{ 1024 };
+	DrawList drawList;
+	ParticleSystem particles;
+	MeshletRenderer meshlets;
+
+	//Cameras around the knot, laid out as a grid over the window
+	RenderView views[MAX_RENDER_VIEWS];
+	uint32_t viewCount = 4;
+
+	float frameDeltaTime = 0.0f;
+
+	//Per-stage spans from the start of initializeVulkan, printed once the deferred pipelines are in
+	Timeline startup;
+
+	//Particle and meshlet pipelines compile in the background while the first frames go out. They get a thread
+	//of their own, as a job any wait() in drawFrame could pick them up and stall that frame for the whole compile.
+	//The thread sets the flag when it's done, drawFrame then checks for an error and sets ready
+	std::thread deferredPipelines;
+	std::atomic<bool> deferredPipelinesDone{ false };
+	std::exception_ptr deferredPipelinesError;
+	bool deferredPipelinesReady = false;
+
+	uint32_t framesThisSecond = 0;
+	double lastTitleUpdate = 0.0;
+	double lastFrameTime = 0.0;
 
 	VkSurfaceFormatKHR chooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& formats);
-	VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& modes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
+	void buildDrawList();
+	void updateWindowTitle();
+	void updateViews(double time);
+	void setPacingMode(PacingMode mode);
+
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
+	void createRenderPass();
+	void createSwapChain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
+	void createDepthResources();
+	void createFrameBuffers();
+	void retireSwapChain();
+	void recreateSwapChain();
 	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	void beginRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawPhase phase);
+	void endRendering(VkCommandBuffer commandBuffer, uint32_t imageIndex, DrawPhase phase);
+	void transitionSwapChainImage(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+	void createInstance();
+	void createDevice();
+	PipelineDesc spritePipelineDesc(PipelineId id) const;
+	void createSpritePipelines(const std::vector<char>& vertShaderSource, const std::vector<char>& fragShaderSource);
+	void compileDeferredPipelines();
+	void waitForDeferredPipelines();
+	void finishStartup();
 
 	void initializeVulkan();
 	void mainLoop();
 	void drawFrame();
-	void dispose();
 
 public:
+	~Application();
+
 	void run();
+
+	//Drives startup and swapchain rebuilds directly to time both render paths
+	friend void benchmarkRenderPaths();
+	friend void benchmarkParticles();
 };
 
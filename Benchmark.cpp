@@ -0,0 +1,167 @@
+#include "Benchmark.h"
+#include "Application.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+void runBenchmarks()
+{
+	benchmarkJobSystem();
+	benchmarkRenderPaths();
+	benchmarkParticles();
+}
+
+void benchmarkJobSystem()
+{
+	const uint32_t itemCount = 1 << 16;
+	const uint32_t iterationsPerItem = 64;
+	const uint32_t frameCount = 30;
+
+	std::vector<float> results(itemCount);
+
+	//Stand-in for transform updates: a chunk of dependent float math per item
+	auto workload = [&results](uint32_t begin, uint32_t end)
+	{
+		for(uint32_t i = begin; i < end; i++)
+		{
+			float value = static_cast<float>(i);
+			for(uint32_t j = 0; j < iterationsPerItem; j++)
+			{
+				value = std::sin(value) * 0.5f + std::cos(value * 0.25f);
+			}
+			results[i] = value;
+		}
+	};
+
+	uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	std::vector<uint32_t> threadCounts;
+	for(uint32_t threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "Job system: " << itemCount << " items x " << iterationsPerItem << " iterations, " << frameCount << " frames" << std::endl;
+	std::cout << "threads  ms/frame  speedup  efficiency" << std::endl;
+
+	double singleThreadTime = 0.0;
+	for(uint32_t threads : threadCounts)
+	{
+		JobSystem jobs(threads - 1);
+
+		//Warm up so thread startup isn't measured
+		jobs.parallelFor(itemCount, 256, workload);
+
+		auto start = std::chrono::steady_clock::now();
+		for(uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			jobs.parallelFor(itemCount, 256, workload);
+		}
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		double frameTime = elapsed.count() / frameCount;
+		if(threads == 1)
+		{
+			singleThreadTime = frameTime;
+		}
+
+		double speedup = singleThreadTime / frameTime;
+		std::cout << std::setw(7) << threads
+			<< std::setw(10) << std::fixed << std::setprecision(2) << frameTime
+			<< std::setw(9) << speedup
+			<< std::setw(11) << std::setprecision(0) << speedup / threads * 100.0 << "%" << std::endl;
+	}
+
+	//Keep the results alive so the workload can't be optimized out
+	float checksum = 0.0f;
+	for(float value : results)
+	{
+		checksum += value;
+	}
+	std::cout << "Checksum: " << std::setprecision(3) << checksum << std::endl;
+}
+
+void benchmarkRenderPaths()
+{
+	const uint32_t recreations = 50;
+
+	std::cout << "Render paths: startup plus " << recreations << " swapchain recreations" << std::endl;
+
+	const std::pair<RenderPath, const char*> paths[] = {
+		{ RenderPath::RenderPass, "render pass" },
+		{ RenderPath::DynamicRendering, "dynamic rendering" }
+	};
+
+	for(const auto& path : paths)
+	{
+		Application app{};
+		app.renderPath = path.first;
+
+		auto start = std::chrono::steady_clock::now();
+		try
+		{
+			app.initializeVulkan();
+		} catch(std::exception& e)
+		{
+			std::cout << path.second << ": skipped (" << e.what() << ")" << std::endl;
+			continue;
+		}
+		std::chrono::duration<double, std::milli> startup = std::chrono::steady_clock::now() - start;
+
+		//The particle and meshlet pipelines are still compiling on their own thread. Let them finish, both so
+		//they don't compete with the recreations and because recreating touches the meshlet renderer they fill in
+		app.waitForDeferredPipelines();
+		std::chrono::duration<double, std::milli> startupWithDeferred = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < recreations; i++)
+		{
+			app.recreateSwapChain();
+
+			//No frames are submitted, so nothing ever collects the retired swapchain. Free it here instead of
+			//letting 50 of them pile up, the device has nothing in flight
+			vkDeviceWaitIdle(app.device);
+			app.deletionQueue.flush();
+		}
+		std::chrono::duration<double, std::milli> recreation = std::chrono::steady_clock::now() - start;
+
+		std::cout << std::fixed << std::setprecision(2) << path.second
+			<< ": startup " << startup.count() << "ms (" << startupWithDeferred.count() << "ms with deferred pipelines)"
+			<< ", swapchain recreation " << recreation.count() / recreations << "ms" << std::endl;
+	}
+}
+
+
+void benchmarkParticles()
+{
+	const uint32_t iterations = 100;
+
+	Application app{};
+	try
+	{
+		app.initializeVulkan();
+	} catch(std::exception& e)
+	{
+		std::cout << "Particles: skipped (" << e.what() << ")" << std::endl;
+		return;
+	}
+
+	//The particle pipelines finish compiling after startup
+	app.waitForDeferredPipelines();
+	app.finishStartup();
+
+	//Once to warm up, once to measure
+	app.particles.measureUpdateRate(1);
+	double rate = app.particles.measureUpdateRate(iterations);
+
+	std::cout << "Particles: " << app.particles.getParticleCount() << " particles x " << iterations << " updates, "
+		<< (app.particles.isAsync() ? "async compute queue" : "graphics queue") << std::endl;
+	std::cout << std::fixed << std::setprecision(1) << rate / 1.0e6 << "M particles/sec" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#pragma once
+
+//Run with --bench instead of opening the normal window
+void runBenchmarks();
+
+//CPU-bound per-frame workload spread over 1..hardware_concurrency threads
+void benchmarkJobSystem();
+
+//Startup and swapchain recreation time, render pass vs dynamic rendering
+void benchmarkRenderPaths();
+
+
+//Compute simulation throughput, back to back updates on the compute queue
+void benchmarkParticles();
\ No newline at end of file
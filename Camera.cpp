@@ -0,0 +1,56 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "Camera.h"
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+Camera Camera::lookAt(const glm::vec3& position, const glm::vec3& target, float fovY, float width, float height,
+	float nearPlane, float farPlane)
+{
+	Camera camera{};
+	camera.position = position;
+	camera.nearPlane = nearPlane;
+	camera.projectionScale = height / (2.0f * std::tan(fovY * 0.5f));
+
+	glm::mat4 view = glm::lookAt(position, target, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 projection = glm::perspective(fovY, width / height, nearPlane, farPlane);
+	projection[1][1] *= -1.0f;
+	camera.viewProjection = projection * view;
+
+	//Gribb-Hartmann, rows of the combined matrix
+	const glm::mat4& m = camera.viewProjection;
+	glm::vec4 rows[4];
+	for(int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+
+	camera.frustum[0] = rows[3] + rows[0];
+	camera.frustum[1] = rows[3] - rows[0];
+	camera.frustum[2] = rows[3] + rows[1];
+	camera.frustum[3] = rows[3] - rows[1];
+	camera.frustum[4] = rows[2];
+	camera.frustum[5] = rows[3] - rows[2];
+
+	for(auto& plane : camera.frustum)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return camera;
+}
+
+bool Camera::sphereVisible(const glm::vec4& sphere) const
+{
+	for(const auto& plane : frustum)
+	{
+		if(glm::dot(glm::vec3(plane), glm::vec3(sphere)) + plane.w < -sphere.w)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+struct Camera
+{
+	glm::vec3 position;
+	glm::mat4 viewProjection;
+
+	//Inward facing planes as (normal, distance): left, right, bottom, top, near, far
+	glm::vec4 frustum[6];
+
+	float nearPlane;
+
+	//Pixels covered by one unit at distance one, turns a world space error into a screen space one
+	float projectionScale;
+
+	//Right handed, Vulkan clip space: y down, depth 0 to 1
+	static Camera lookAt(const glm::vec3& position, const glm::vec3& target, float fovY, float width, float height,
+		float nearPlane, float farPlane);
+
+	bool sphereVisible(const glm::vec4& sphere) const;
+};
@@ -0,0 +1,14 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::collect(uint64_t completedFrame)
+{
+	while(!entries.empty() && entries.front().frame <= completedFrame)
+	{
+		entries.pop_front();
+	}
+}
+
+void DeletionQueue::flush()
+{
+	entries.clear();
+}
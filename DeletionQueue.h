@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+//Holds released resources until the GPU has finished the last frame that could have used them,
+//so they can be dropped mid-run without waiting for the device to go idle.
+//Frames are numbered by submission, and a frame counts as finished once its fence has signaled
+class DeletionQueue
+{
+private:
+	struct Entry
+	{
+		uint64_t frame;
+
+		//Type erased, dropping the last reference runs the resource's own destructor
+		std::shared_ptr<void> resource;
+	};
+
+	//Retired in frame order, so everything collectable sits at the front
+	std::deque<Entry> entries;
+
+public:
+	//Takes ownership of any move-only resource (handles, Buffer, Image, vectors of them) last used by frame
+	template<typename T>
+	void retire(uint64_t frame, T&& resource)
+	{
+		static_assert(!std::is_lvalue_reference_v<T>, "Retire by moving the resource in");
+		entries.push_back({ frame, std::make_shared<T>(std::move(resource)) });
+	}
+
+	//Destroys everything last used by completedFrame or earlier
+	void collect(uint64_t completedFrame);
+
+	//Destroys everything, only once the device is idle
+	void flush();
+
+	size_t size() const { return entries.size(); }
+};
@@ -0,0 +1,216 @@
+#include "DrawList.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//Below this many draws one thread sorts faster than the job system can hand out chunks
+static constexpr uint32_t PARALLEL_SORT_THRESHOLD = 8192;
+static constexpr uint32_t MIN_CHUNK_SIZE = 2048;
+static constexpr uint32_t RADIX = 256;
+
+static constexpr uint32_t DEPTH_SHIFT = 0;
+static constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DrawList::DEPTH_BITS;
+static constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + DrawList::MESH_BITS;
+static constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + DrawList::MATERIAL_BITS;
+static_assert(PIPELINE_SHIFT + DrawList::PIPELINE_BITS == 64, "Sort key fields must fill 64 bits");
+
+static constexpr uint64_t fieldMask(uint32_t bits)
+{
+	return (uint64_t(1) << bits) - 1;
+}
+
+uint64_t DrawList::makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	//Quantize depth so it orders correctly as an unsigned integer
+	float clamped = std::clamp(depth, 0.0f, 1.0f);
+	uint64_t quantizedDepth = static_cast<uint64_t>(clamped * static_cast<float>(fieldMask(DEPTH_BITS)));
+
+	return (uint64_t(pipeline) & fieldMask(PIPELINE_BITS)) << PIPELINE_SHIFT
+		| (uint64_t(material) & fieldMask(MATERIAL_BITS)) << MATERIAL_SHIFT
+		| (uint64_t(mesh) & fieldMask(MESH_BITS)) << MESH_SHIFT
+		| quantizedDepth << DEPTH_SHIFT;
+}
+
+uint32_t DrawList::keyPipeline(uint64_t key)
+{
+	return static_cast<uint32_t>((key >> PIPELINE_SHIFT) & fieldMask(PIPELINE_BITS));
+}
+
+uint32_t DrawList::keyMaterial(uint64_t key)
+{
+	return static_cast<uint32_t>((key >> MATERIAL_SHIFT) & fieldMask(MATERIAL_BITS));
+}
+
+uint32_t DrawList::keyMesh(uint64_t key)
+{
+	return static_cast<uint32_t>((key >> MESH_SHIFT) & fieldMask(MESH_BITS));
+}
+
+void DrawList::clear(std::pmr::memory_resource* memory)
+{
+	//Rebuilt rather than cleared, an arena reset has already taken the old storage away underneath it
+	storage.emplace(memory);
+	stats = {};
+}
+
+void DrawList::reserve(size_t count)
+{
+	storage->items.reserve(count);
+	storage->scratch.reserve(count);
+	storage->batches.reserve(count);
+}
+
+void DrawList::add(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth, uint32_t objectIndex)
+{
+	if(pipeline > fieldMask(PIPELINE_BITS) || material > fieldMask(MATERIAL_BITS) || mesh > fieldMask(MESH_BITS))
+	{
+		throw std::runtime_error("Draw state doesn't fit in the sort key!");
+	}
+
+	storage->items.push_back({ makeKey(pipeline, material, mesh, depth), objectIndex });
+}
+
+void DrawList::sort(JobSystem& jobs)
+{
+	auto& items = storage->items;
+	auto& scratch = storage->scratch;
+	auto& histograms = storage->histograms;
+
+	const uint32_t count = static_cast<uint32_t>(items.size());
+	if(count < 2)
+	{
+		return;
+	}
+
+	uint32_t chunkCount = 1;
+	if(count >= PARALLEL_SORT_THRESHOLD)
+	{
+		chunkCount = std::max(1u, std::min(jobs.threadCount() * 4, count / MIN_CHUNK_SIZE));
+	}
+	const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+	scratch.resize(count);
+	histograms.resize(static_cast<size_t>(chunkCount) * RADIX);
+
+	DrawItem* source = items.data();
+	DrawItem* destination = scratch.data();
+	bool sortedIntoScratch = false;
+
+	for(uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		std::fill(histograms.begin(), histograms.end(), 0);
+
+		jobs.parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for(uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				uint32_t* counts = &histograms[static_cast<size_t>(chunk) * RADIX];
+				uint32_t last = std::min(count, (chunk + 1) * chunkSize);
+				for(uint32_t i = chunk * chunkSize; i < last; i++)
+				{
+					counts[(source[i].key >> shift) & (RADIX - 1)]++;
+				}
+			}
+		});
+
+		//Skip the pass when every key has the same digit, which is most passes for a small scene
+		bool trivialPass = false;
+		for(uint32_t digit = 0; digit < RADIX && !trivialPass; digit++)
+		{
+			uint32_t total = 0;
+			for(uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				total += histograms[static_cast<size_t>(chunk) * RADIX + digit];
+			}
+			trivialPass = total == count;
+		}
+
+		if(trivialPass)
+		{
+			continue;
+		}
+
+		//Digit-major, chunk-minor offsets keep the sort stable
+		uint32_t offset = 0;
+		for(uint32_t digit = 0; digit < RADIX; digit++)
+		{
+			for(uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				uint32_t& slot = histograms[static_cast<size_t>(chunk) * RADIX + digit];
+				uint32_t digitCount = slot;
+				slot = offset;
+				offset += digitCount;
+			}
+		}
+
+		jobs.parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for(uint32_t chunk = begin; chunk < end; chunk++)
+			{
+				uint32_t* offsets = &histograms[static_cast<size_t>(chunk) * RADIX];
+				uint32_t last = std::min(count, (chunk + 1) * chunkSize);
+				for(uint32_t i = chunk * chunkSize; i < last; i++)
+				{
+					destination[offsets[(source[i].key >> shift) & (RADIX - 1)]++] = source[i];
+				}
+			}
+		});
+
+		std::swap(source, destination);
+		sortedIntoScratch = !sortedIntoScratch;
+	}
+
+	if(sortedIntoScratch)
+	{
+		items.swap(scratch);
+	}
+}
+
+void DrawList::build()
+{
+	const auto& items = storage->items;
+	auto& batches = storage->batches;
+
+	batches.clear();
+	stats = {};
+
+	uint32_t boundPipeline = UINT32_MAX;
+	uint32_t boundMaterial = UINT32_MAX;
+
+	for(uint32_t i = 0; i < items.size(); i++)
+	{
+		uint64_t key = items[i].key;
+		uint32_t pipeline = keyPipeline(key);
+		uint32_t material = keyMaterial(key);
+		uint32_t mesh = keyMesh(key);
+
+		if(!batches.empty())
+		{
+			DrawBatch& last = batches.back();
+			if(last.pipeline == pipeline && last.material == material && last.mesh == mesh)
+			{
+				last.instanceCount++;
+				continue;
+			}
+		}
+
+		//Pipelines share a layout, so material state survives a pipeline bind
+		DrawBatch batch{};
+		batch.pipeline = pipeline;
+		batch.material = material;
+		batch.mesh = mesh;
+		batch.firstInstance = i;
+		batch.instanceCount = 1;
+		batch.bindPipeline = pipeline != boundPipeline;
+		batch.bindMaterial = material != boundMaterial;
+		batches.push_back(batch);
+
+		boundPipeline = pipeline;
+		boundMaterial = material;
+
+		stats.pipelineBinds += batch.bindPipeline ? 1 : 0;
+		stats.descriptorBinds += batch.bindMaterial ? 1 : 0;
+		stats.draws++;
+	}
+}
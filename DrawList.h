@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+class JobSystem;
+
+struct DrawItem
+{
+	uint64_t key;
+	uint32_t objectIndex;
+};
+
+//A run of sorted draws that share pipeline, material and mesh, recorded as one instanced draw
+struct DrawBatch
+{
+	uint32_t pipeline;
+	uint32_t material;
+	uint32_t mesh;
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+	bool bindPipeline;
+	bool bindMaterial;
+};
+
+struct DrawStats
+{
+	uint32_t pipelineBinds;
+	uint32_t descriptorBinds;
+	uint32_t draws;
+};
+
+class DrawList
+{
+private:
+	//Everything that is rebuilt every frame, allocated from the memory handed to clear()
+	struct Storage
+	{
+		std::pmr::vector<DrawItem> items;
+		std::pmr::vector<DrawItem> scratch;
+		std::pmr::vector<DrawBatch> batches;
+
+		//Per-chunk digit counts for the radix sort
+		std::pmr::vector<uint32_t> histograms;
+
+		explicit Storage(std::pmr::memory_resource* memory) : items(memory), scratch(memory), batches(memory), histograms(memory) {}
+	};
+
+	std::optional<Storage> storage;
+	DrawStats stats{};
+
+public:
+	//Key layout from most to least significant: pipeline | material | mesh | depth
+	static constexpr uint32_t PIPELINE_BITS = 8;
+	static constexpr uint32_t MATERIAL_BITS = 16;
+	static constexpr uint32_t MESH_BITS = 16;
+	static constexpr uint32_t DEPTH_BITS = 24;
+
+	static uint64_t makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+	static uint32_t keyPipeline(uint64_t key);
+	static uint32_t keyMaterial(uint64_t key);
+	static uint32_t keyMesh(uint64_t key);
+
+	//Starts an empty list in memory, usually the frame arena, which has to stay alive until the next clear()
+	void clear(std::pmr::memory_resource* memory);
+	void reserve(size_t count);
+
+	//depth is expected in [0, 1], lower values sort first
+	void add(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth, uint32_t objectIndex);
+
+	//LSD radix sort over the keys, one parallel histogram and scatter per byte
+	void sort(JobSystem& jobs);
+
+	//Merges equal-state neighbours into batches and works out which binds each batch needs
+	void build();
+
+	const std::pmr::vector<DrawItem>& getItems() const { return storage->items; }
+	const std::pmr::vector<DrawBatch>& getBatches() const { return storage->batches; }
+	const DrawStats& getStats() const { return stats; }
+};
@@ -0,0 +1,51 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+
+FrameArena::FrameArena(size_t capacity, std::pmr::memory_resource* upstream)
+	: block(std::make_unique<std::byte[]>(capacity)), capacity(capacity), upstream(upstream)
+{
+}
+
+void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+	uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+
+	size_t current = offset.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		size_t aligned = ((base + current + alignment - 1) & ~(uintptr_t(alignment) - 1)) - base;
+		if(aligned + bytes > capacity)
+		{
+			overflows.fetch_add(1, std::memory_order_relaxed);
+			return upstream->allocate(bytes, alignment);
+		}
+
+		if(offset.compare_exchange_weak(current, aligned + bytes, std::memory_order_relaxed))
+		{
+			return block.get() + aligned;
+		}
+	}
+}
+
+void FrameArena::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+	//Arena memory goes all at once in reset(), only overflow has to be handed back
+	std::byte* address = static_cast<std::byte*>(pointer);
+	if(address < block.get() || address >= block.get() + capacity)
+	{
+		upstream->deallocate(pointer, bytes, alignment);
+	}
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+	return this == &other;
+}
+
+void FrameArena::reset()
+{
+	peak = std::max(peak, offset.load(std::memory_order_relaxed));
+	offset.store(0, std::memory_order_relaxed);
+	overflows.store(0, std::memory_order_relaxed);
+}
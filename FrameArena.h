@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+//Linear allocator for everything that only lives for one frame. Allocating bumps an offset, freeing is a
+//no-op, and reset() drops the lot at the frame boundary. Containers take it as a std::pmr resource.
+//Whatever doesn't fit comes from upstream instead and is counted, so a frame that outgrows the arena shows up
+class FrameArena : public std::pmr::memory_resource
+{
+private:
+	std::unique_ptr<std::byte[]> block;
+	size_t capacity;
+	std::pmr::memory_resource* upstream;
+
+	//Jobs of the same frame allocate side by side
+	std::atomic<size_t> offset{ 0 };
+	std::atomic<uint32_t> overflows{ 0 };
+	size_t peak = 0;
+
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+public:
+	explicit FrameArena(size_t capacity, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	//Nothing allocated since the last reset may be used afterwards, containers holding it have to be rebuilt
+	void reset();
+
+	size_t used() const { return offset.load(std::memory_order_relaxed); }
+	size_t getCapacity() const { return capacity; }
+	size_t getPeak() const { return peak; }
+
+	//Allocations since the last reset that went upstream
+	uint32_t getOverflows() const { return overflows.load(std::memory_order_relaxed); }
+};
@@ -0,0 +1,162 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using Seconds = std::chrono::duration<double>;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+const char* FramePacer::modeName(PacingMode mode)
+{
+	switch(mode)
+	{
+	case PacingMode::MaxThroughput:
+		return "max throughput";
+	case PacingMode::LowLatency:
+		return "low latency";
+	case PacingMode::FixedRate:
+		return "fixed rate";
+	default:
+		return "unknown";
+	}
+}
+
+void FramePacer::setMode(PacingMode newMode, double frameRate)
+{
+	mode = newMode;
+	targetFrameRate = frameRate;
+	nextFrameStart = Clock::now();
+	frameWorkTime = 0.0;
+}
+
+uint32_t FramePacer::framesInFlight() const
+{
+	return mode == PacingMode::LowLatency ? 1 : MAX_FRAMES_IN_FLIGHT;
+}
+
+uint32_t FramePacer::swapChainImageCount(const VkSurfaceCapabilitiesKHR& capabilities) const
+{
+	//Every extra image is another frame that can queue up in front of the display
+	uint32_t count = mode == PacingMode::LowLatency ? std::max(capabilities.minImageCount, 2u) : capabilities.minImageCount + 1;
+
+	if(capabilities.maxImageCount > 0)
+	{
+		count = std::min(count, capabilities.maxImageCount);
+	}
+	return count;
+}
+
+VkPresentModeKHR FramePacer::choosePresentMode(const std::vector<VkPresentModeKHR>& modes) const
+{
+	auto supported = [&modes](VkPresentModeKHR presentMode)
+	{
+		return std::find(modes.begin(), modes.end(), presentMode) != modes.end();
+	};
+
+	switch(mode)
+	{
+	case PacingMode::MaxThroughput:
+	case PacingMode::FixedRate: // The sleep sets the rate, don't let vsync stack on top of it
+		if(supported(VK_PRESENT_MODE_MAILBOX_KHR)) // Triple-buffering without tearing
+		{
+			return VK_PRESENT_MODE_MAILBOX_KHR;
+		}
+		if(supported(VK_PRESENT_MODE_IMMEDIATE_KHR))
+		{
+			return VK_PRESENT_MODE_IMMEDIATE_KHR;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return VK_PRESENT_MODE_FIFO_KHR; // Always supported, and low latency needs a steady vsync to aim for
+}
+
+void FramePacer::sleepUntil(Clock::time_point time)
+{
+	//sleep_until can overshoot by a scheduler tick, so sleep most of the way and spin the rest
+	Clock::time_point coarse = time - std::chrono::milliseconds(1);
+	if(Clock::now() < coarse)
+	{
+		std::this_thread::sleep_until(coarse);
+	}
+
+	while(Clock::now() < time)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void FramePacer::waitForFrameStart()
+{
+	Clock::time_point now = Clock::now();
+
+	if(mode == PacingMode::FixedRate)
+	{
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(Seconds(1.0 / targetFrameRate));
+		nextFrameStart += period;
+
+		//More than a frame behind, don't try to catch up
+		if(nextFrameStart + period < now)
+		{
+			nextFrameStart = now;
+		}
+		sleepUntil(nextFrameStart);
+	}
+	else if(mode == PacingMode::LowLatency)
+	{
+		//Without present timing extensions, assume vsync lands one refresh after the last acquire unblocked
+		Seconds delay(refreshInterval - frameWorkTime - LOW_LATENCY_MARGIN);
+		Clock::time_point start = lastAcquireEnd + std::chrono::duration_cast<Clock::duration>(delay);
+		Clock::time_point latest = now + std::chrono::duration_cast<Clock::duration>(Seconds(refreshInterval));
+		sleepUntil(std::min(start, latest));
+	}
+
+	frameStart = Clock::now();
+}
+
+void FramePacer::beginAcquire()
+{
+	acquireStart = Clock::now();
+}
+
+void FramePacer::endAcquire()
+{
+	Clock::time_point now = Clock::now();
+
+	//Ignore intervals that can't be a display refresh (first frame, mode switches, hitches)
+	double interval = Seconds(now - lastAcquireEnd).count();
+	if(interval > 1.0 / 240.0 && interval < 1.0 / 24.0)
+	{
+		refreshInterval = refreshInterval * 0.9 + interval * 0.1;
+	}
+
+	//Time spent blocked in acquire isn't work, it means the frame started too early
+	blockedInAcquire = Seconds(now - acquireStart).count();
+	lastAcquireEnd = now;
+}
+
+void FramePacer::endPresent()
+{
+	Clock::time_point now = Clock::now();
+
+	latency[static_cast<size_t>(mode)].add(Milliseconds(now - acquireStart).count());
+
+	double work = Seconds(now - frameStart).count() - blockedInAcquire;
+	frameWorkTime = frameWorkTime > 0.0 ? frameWorkTime * 0.9 + work * 0.1 : work;
+}
+
+void FramePacer::printLatency() const
+{
+	for(size_t i = 0; i < static_cast<size_t>(PacingMode::Count); i++)
+	{
+		const Histogram& histogram = latency[i];
+		if(histogram.getCount() > 0)
+		{
+			histogram.print(std::cout, std::string("Acquire to present (") + modeName(static_cast<PacingMode>(i)) + ")", "ms");
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Profiler.h"
+
+enum class PacingMode
+{
+	MaxThroughput, // Uncapped, MAILBOX or IMMEDIATE with every frame in flight
+	LowLatency,    // FIFO, one frame in flight and the frame starts as late as possible before vsync
+	FixedRate,     // Sleeps to hold a target frame rate
+	Count
+};
+
+class FramePacer
+{
+private:
+	using Clock = std::chrono::steady_clock;
+
+	PacingMode mode = PacingMode::MaxThroughput;
+	double targetFrameRate = 60.0;
+
+	Clock::time_point frameStart;
+	Clock::time_point nextFrameStart;
+	Clock::time_point acquireStart;
+	Clock::time_point lastAcquireEnd;
+
+	//Smoothed estimates in seconds, used to place the low latency frame start
+	double refreshInterval = 1.0 / 60.0;
+	double frameWorkTime = 0.0;
+	double blockedInAcquire = 0.0;
+
+	//Acquire-to-present time in milliseconds, one per mode
+	Histogram latency[static_cast<size_t>(PacingMode::Count)];
+
+	static void sleepUntil(Clock::time_point time);
+
+public:
+	static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+
+	//Slack left between the predicted end of the frame's CPU work and vsync
+	static constexpr double LOW_LATENCY_MARGIN = 0.002;
+
+	static const char* modeName(PacingMode mode);
+
+	void setMode(PacingMode newMode, double frameRate = 60.0);
+	PacingMode getMode() const { return mode; }
+
+	uint32_t framesInFlight() const;
+	uint32_t swapChainImageCount(const VkSurfaceCapabilitiesKHR& capabilities) const;
+	VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& modes) const;
+
+	//Blocks until the next frame should start sampling input and simulating
+	void waitForFrameStart();
+
+	void beginAcquire();
+	void endAcquire();
+	void endPresent();
+
+	void printLatency() const;
+};
@@ -0,0 +1,382 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//Index into JobSystem::workers for whichever thread is running, 0 for the thread that owns the job system.
+//Any other thread keeps the sentinel and is turned away, it would otherwise share worker 0's queue and pool
+static constexpr uint32_t FOREIGN_THREAD = UINT32_MAX;
+static thread_local uint32_t workerIndex = FOREIGN_THREAD;
+
+bool WorkStealingQueue::push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if(b - t >= CAPACITY)
+	{
+		return false;
+	}
+
+	jobs[b & MASK].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* WorkStealingQueue::pop()
+{
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if(t > b)
+	{
+		//Queue was already empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & MASK].load(std::memory_order_relaxed);
+	if(t == b)
+	{
+		//Last job, race any thieves for it
+		if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		{
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* WorkStealingQueue::steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+
+	if(t >= b)
+	{
+		return nullptr;
+	}
+
+	Job* job = jobs[t & MASK].load(std::memory_order_relaxed);
+	if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+	{
+		//Lost the race against pop() or another thief
+		return nullptr;
+	}
+	return job;
+}
+
+uint32_t JobSystem::defaultWorkerCount()
+{
+	uint32_t cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 0;
+}
+
+JobSystem::JobSystem(uint32_t workerThreads)
+{
+	static_assert((JOB_POOL_SIZE & (JOB_POOL_SIZE - 1)) == 0, "Job pool size must be a power of two");
+
+	workers.resize(workerThreads + 1);
+	for(uint32_t i = 0; i < workers.size(); i++)
+	{
+		workers[i] = std::make_unique<Worker>();
+		workers[i]->jobPool = std::make_unique<Job[]>(JOB_POOL_SIZE);
+		workers[i]->stealSeed = i * 2654435761u + 1;
+	}
+
+	workerIndex = 0;
+	for(uint32_t i = 1; i < workers.size(); i++)
+	{
+		threads.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	running = false;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_all();
+	}
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+JobSystem::Worker& JobSystem::currentWorker()
+{
+	if(workerIndex >= workers.size())
+	{
+		throw std::runtime_error("Job system used from a thread that is neither a worker nor its owner!");
+	}
+	return *workers[workerIndex];
+}
+
+Job* JobSystem::allocateJob()
+{
+	Worker& worker = currentWorker();
+
+	//Step over slots still held by long running jobs, which may outlive a whole trip around the ring
+	Job* job = nullptr;
+	for(uint32_t i = 0; i < JOB_POOL_SIZE && job == nullptr; i++)
+	{
+		Job* slot = &worker.jobPool[worker.allocatedJobs++ & (JOB_POOL_SIZE - 1)];
+		if(slot->unfinishedJobs.load(std::memory_order_acquire) == 0)
+		{
+			job = slot;
+		}
+	}
+
+	if(job == nullptr)
+	{
+		throw std::runtime_error("Job pool exhausted!");
+	}
+
+	job->parent = nullptr;
+	job->unfinishedJobs.store(1, std::memory_order_relaxed);
+	job->pendingDependencies.store(1, std::memory_order_relaxed);
+	job->continuationCount.store(0, std::memory_order_relaxed);
+	job->failed.store(false, std::memory_order_relaxed);
+	job->exception = nullptr;
+	return job;
+}
+
+Job* JobSystem::createJob(std::function<void()> function)
+{
+	Job* job = allocateJob();
+	job->function = std::move(function);
+	return job;
+}
+
+Job* JobSystem::createChildJob(Job* parent, std::function<void()> function)
+{
+	//Allocate before counting the child, a throw from a full ring must not leave the parent waiting on it
+	Job* job = allocateJob();
+	job->function = std::move(function);
+	job->parent = parent;
+
+	parent->unfinishedJobs.fetch_add(1, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::addDependency(Job* job, Job* dependency)
+{
+	int32_t slot = dependency->continuationCount.fetch_add(1, std::memory_order_relaxed);
+	if(slot >= Job::MAX_CONTINUATIONS)
+	{
+		throw std::runtime_error("Too many jobs depend on a single job!");
+	}
+
+	job->pendingDependencies.fetch_add(1, std::memory_order_relaxed);
+	dependency->continuations[slot] = job;
+}
+
+void JobSystem::run(Job* job)
+{
+	release(job);
+}
+
+void JobSystem::release(Job* job)
+{
+	if(job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		push(job);
+	}
+}
+
+void JobSystem::push(Job* job)
+{
+	queuedJobs.fetch_add(1);
+	if(!currentWorker().queue.push(job))
+	{
+		//Queue is full, don't drop the job on the floor
+		queuedJobs.fetch_sub(1);
+		execute(job);
+		return;
+	}
+
+	if(sleepingWorkers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+Job* JobSystem::getJob()
+{
+	Worker& worker = currentWorker();
+	Job* job = worker.queue.pop();
+
+	if(job == nullptr && workers.size() > 1)
+	{
+		//Nothing local, go steal from someone else starting at a random victim
+		worker.stealSeed ^= worker.stealSeed << 13;
+		worker.stealSeed ^= worker.stealSeed >> 17;
+		worker.stealSeed ^= worker.stealSeed << 5;
+
+		uint32_t count = static_cast<uint32_t>(workers.size());
+		uint32_t start = worker.stealSeed % count;
+		for(uint32_t i = 0; i < count && job == nullptr; i++)
+		{
+			uint32_t victim = (start + i) % count;
+			if(victim != workerIndex)
+			{
+				job = workers[victim]->queue.steal();
+			}
+		}
+	}
+
+	if(job != nullptr)
+	{
+		queuedJobs.fetch_sub(1);
+	}
+	return job;
+}
+
+void JobSystem::execute(Job* job)
+{
+	if(job->function)
+	{
+		try
+		{
+			job->function();
+		} catch(...)
+		{
+			fail(job, std::current_exception());
+		}
+	}
+	finish(job);
+}
+
+void JobSystem::fail(Job* job, std::exception_ptr exception)
+{
+	//Walk up until a job already holds an exception, only the first one is kept
+	for(; job != nullptr; job = job->parent)
+	{
+		if(job->failed.exchange(true))
+		{
+			break;
+		}
+		job->exception = exception;
+	}
+}
+
+void JobSystem::finish(Job* job)
+{
+	//Copy everything out before the decrement, once it reaches zero the slot can be reallocated and overwritten
+	Job* parent = job->parent;
+	int32_t continuationCount = std::min(job->continuationCount.load(std::memory_order_relaxed), Job::MAX_CONTINUATIONS);
+	Job* continuations[Job::MAX_CONTINUATIONS];
+	std::copy(job->continuations, job->continuations + continuationCount, continuations);
+
+	if(job->unfinishedJobs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+	{
+		return;
+	}
+
+	for(int32_t i = 0; i < continuationCount; i++)
+	{
+		release(continuations[i]);
+	}
+
+	if(parent != nullptr)
+	{
+		finish(parent);
+	}
+}
+
+bool JobSystem::isFinished(const Job* job) const
+{
+	return job->unfinishedJobs.load(std::memory_order_acquire) == 0;
+}
+
+void JobSystem::wait(const Job* job)
+{
+	//Help out instead of blocking so waiting inside a job can't deadlock
+	while(!isFinished(job))
+	{
+		Job* next = getJob();
+		if(next != nullptr)
+		{
+			execute(next);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	if(job->failed.load(std::memory_order_acquire))
+	{
+		std::rethrow_exception(job->exception);
+	}
+}
+
+void JobSystem::spawnRange(const ParallelRange* range, uint32_t begin, uint32_t end)
+{
+	Job* job = createChildJob(range->parent, [range, begin, end]()
+	{
+		if(end - begin > range->grainSize)
+		{
+			//Split in half so thieves take big chunks off the top of the queue
+			uint32_t middle = begin + (end - begin) / 2;
+			range->system->spawnRange(range, middle, end);
+			range->system->spawnRange(range, begin, middle);
+		}
+		else
+		{
+			range->invoke(range->body, begin, end);
+		}
+	});
+	run(job);
+}
+
+void JobSystem::runParallelFor(uint32_t count, ParallelRange& range)
+{
+	if(count == 0)
+	{
+		return;
+	}
+
+	range.system = this;
+	range.parent = createJob(nullptr);
+	range.grainSize = std::max(range.grainSize, 1u);
+	spawnRange(&range, 0, count);
+	run(range.parent);
+	wait(range.parent);
+}
+
+void JobSystem::workerLoop(uint32_t index)
+{
+	workerIndex = index;
+
+	uint32_t idleSpins = 0;
+	while(running.load(std::memory_order_relaxed))
+	{
+		Job* job = getJob();
+		if(job != nullptr)
+		{
+			execute(job);
+			idleSpins = 0;
+		}
+		else if(++idleSpins < 64)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			//Nothing to do for a while, sleep until someone pushes a job
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepingWorkers.fetch_add(1);
+			wakeCondition.wait(lock, [this]() { return queuedJobs.load() > 0 || !running.load(); });
+			sleepingWorkers.fetch_sub(1);
+			idleSpins = 0;
+		}
+	}
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job
+{
+	static constexpr int32_t MAX_CONTINUATIONS = 14;
+
+	std::function<void()> function;
+	Job* parent;
+
+	//Counts the job itself plus every child that hasn't finished yet
+	std::atomic<int32_t> unfinishedJobs;
+
+	//Starts at 1 so the job can't be queued until run() is called
+	std::atomic<int32_t> pendingDependencies;
+
+	std::atomic<int32_t> continuationCount;
+	Job* continuations[MAX_CONTINUATIONS];
+
+	//First exception thrown by the job or any of its children, rethrown by JobSystem::wait
+	std::atomic<bool> failed;
+	std::exception_ptr exception;
+};
+
+//Chase-Lev deque: the owning thread pushes and pops at the bottom, thieves steal from the top
+class WorkStealingQueue
+{
+private:
+	static constexpr int64_t CAPACITY = 4096;
+	static constexpr int64_t MASK = CAPACITY - 1;
+
+	std::atomic<int64_t> top{ 0 };
+	std::atomic<int64_t> bottom{ 0 };
+	std::atomic<Job*> jobs[CAPACITY];
+
+public:
+	bool push(Job* job);
+	Job* pop();
+	Job* steal();
+};
+
+class JobSystem
+{
+private:
+	static constexpr uint32_t JOB_POOL_SIZE = 4096;
+
+	//Per-thread state, index 0 belongs to the thread that created the job system
+	struct Worker
+	{
+		WorkStealingQueue queue;
+		std::unique_ptr<Job[]> jobPool;
+		uint32_t allocatedJobs = 0;
+		uint32_t stealSeed = 0;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::atomic<bool> running{ true };
+	std::atomic<int32_t> queuedJobs{ 0 };
+	std::atomic<int32_t> sleepingWorkers{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wakeCondition;
+
+	Worker& currentWorker();
+	Job* allocateJob();
+	Job* getJob();
+	void push(Job* job);
+	void execute(Job* job);
+	void finish(Job* job);
+	void fail(Job* job, std::exception_ptr exception);
+	void release(Job* job);
+	void workerLoop(uint32_t index);
+
+	//Everything the ranges of one parallelFor share, kept on its stack. The body is only referenced, which
+	//keeps each range's job function down to a pointer and two indices that std::function stores inline
+	struct ParallelRange
+	{
+		JobSystem* system;
+		Job* parent;
+		uint32_t grainSize;
+		const void* body;
+		void (*invoke)(const void* body, uint32_t begin, uint32_t end);
+	};
+
+	void spawnRange(const ParallelRange* range, uint32_t begin, uint32_t end);
+	void runParallelFor(uint32_t count, ParallelRange& range);
+
+public:
+	//workerThreads excludes the calling thread, which also executes jobs while it waits. Only that thread and
+	//the workers may create, run or wait on jobs, any other thread gets an exception
+	explicit JobSystem(uint32_t workerThreads = defaultWorkerCount());
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	static uint32_t defaultWorkerCount();
+
+	uint32_t threadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	//Jobs live in a per-thread ring. Unfinished jobs keep their slot however long they take, but a finished
+	//job's slot gets reused, so only poll or wait on a job that is known not to have been recycled yet.
+	//Every created job must be run, one that never is holds its slot, and its parent, forever. Create a job
+	//right before running it, with nothing that can throw in between
+	Job* createJob(std::function<void()> function);
+	Job* createChildJob(Job* parent, std::function<void()> function);
+
+	//job won't start until dependency has finished. Both jobs must not have been run yet
+	void addDependency(Job* job, Job* dependency);
+
+	void run(Job* job);
+	//Runs other jobs while waiting and rethrows anything the job or its children threw
+	void wait(const Job* job);
+	bool isFinished(const Job* job) const;
+
+	//Splits [0, count) into ranges of at most grainSize and blocks until all of them ran.
+	//function(begin, end) is called in place rather than copied, so it may capture as much as it likes
+	template<typename Function>
+	void parallelFor(uint32_t count, uint32_t grainSize, const Function& function)
+	{
+		ParallelRange range{};
+		range.grainSize = grainSize;
+		range.body = &function;
+		range.invoke = [](const void* body, uint32_t begin, uint32_t end)
+		{
+			(*static_cast<const Function*>(body))(begin, end);
+		};
+		runParallelFor(count, range);
+	}
+};
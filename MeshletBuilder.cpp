@@ -0,0 +1,971 @@
+#include "MeshletBuilder.h"
+#include "JobSystem.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+static constexpr uint32_t FILE_MAGIC = 0x4C48534D; // "MSHL"
+static constexpr uint32_t FILE_VERSION = 1;
+
+//Clusters merged per simplification step, bigger groups lock a smaller share of their vertices on the border.
+//A step also has to remove enough triangles to be worth another level
+static constexpr uint32_t GROUP_SIZE = 16;
+static constexpr float MIN_REDUCTION = 0.85f;
+
+static constexpr uint32_t NO_GROUP = ~0u;
+static constexpr uint32_t SHARED_VERTEX = ~0u - 1;
+
+static uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+	return a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if(triangleCount == 0)
+	{
+		return;
+	}
+
+	//Triangles around each vertex, packed
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for(uint32_t index : indices)
+	{
+		liveTriangles[index]++;
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for(uint32_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for(uint32_t t = 0; t < triangleCount; t++)
+	{
+		for(uint32_t k = 0; k < 3; k++)
+		{
+			adjacency[fill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<uint8_t> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+
+	//Falls back to recently used vertices, then to the first one still referenced
+	auto skipDeadEnd = [&]() -> int64_t
+	{
+		while(!deadEnd.empty())
+		{
+			uint32_t vertex = deadEnd.back();
+			deadEnd.pop_back();
+			if(liveTriangles[vertex] > 0)
+			{
+				return vertex;
+			}
+		}
+
+		for(; cursor < vertexCount; cursor++)
+		{
+			if(liveTriangles[cursor] > 0)
+			{
+				return cursor;
+			}
+		}
+		return -1;
+	};
+
+	int64_t fanning = skipDeadEnd();
+	while(fanning >= 0)
+	{
+		//Emit everything around the fanning vertex
+		candidates.clear();
+		for(uint32_t i = adjacencyOffsets[fanning]; i < adjacencyOffsets[fanning + 1]; i++)
+		{
+			uint32_t t = adjacency[i];
+			if(emitted[t])
+			{
+				continue;
+			}
+
+			for(uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t vertex = indices[t * 3 + k];
+				output.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+
+				if(time - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = time++;
+				}
+			}
+			emitted[t] = 1;
+		}
+
+		//Next fan from the candidate that will still be in cache, preferring the oldest
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for(uint32_t vertex : candidates)
+		{
+			if(liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+
+			int64_t priority = 0;
+			if(time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = time - cacheTime[vertex];
+			}
+
+			if(priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = vertex;
+			}
+		}
+
+		fanning = best >= 0 ? best : skipDeadEnd();
+	}
+
+	indices.swap(output);
+}
+
+static glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	return glm::cross(b - a, c - a);
+}
+
+//Center and radius of a sphere around all the given spheres, not minimal but cheap and conservative
+static glm::vec4 mergeSpheres(const std::vector<glm::vec4>& spheres)
+{
+	glm::vec3 center(0.0f);
+	for(const auto& sphere : spheres)
+	{
+		center += glm::vec3(sphere);
+	}
+	center /= static_cast<float>(spheres.size());
+
+	float radius = 0.0f;
+	for(const auto& sphere : spheres)
+	{
+		radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+	}
+	return glm::vec4(center, radius);
+}
+
+static void computeBounds(const MeshletMesh& mesh, Meshlet& meshlet)
+{
+	const uint32_t* vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+	const uint8_t* triangles = &mesh.meshletTriangles[meshlet.triangleOffset];
+
+	glm::vec3 minimum(std::numeric_limits<float>::max());
+	glm::vec3 maximum(-std::numeric_limits<float>::max());
+	for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+	{
+		const glm::vec3& position = mesh.vertices[vertices[i]].position;
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+
+	glm::vec3 center = (minimum + maximum) * 0.5f;
+	float radius = 0.0f;
+	for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+	{
+		radius = std::max(radius, glm::length(mesh.vertices[vertices[i]].position - center));
+	}
+	meshlet.bounds = glm::vec4(center, radius);
+
+	//Normal cone: average face direction, opened up far enough to contain every face
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangleCount);
+	glm::vec3 axis(0.0f);
+	for(uint32_t t = 0; t < meshlet.triangleCount; t++)
+	{
+		glm::vec3 normal = triangleNormal(mesh.vertices[vertices[triangles[t * 3 + 0]]].position,
+			mesh.vertices[vertices[triangles[t * 3 + 1]]].position,
+			mesh.vertices[vertices[triangles[t * 3 + 2]]].position);
+
+		float length = glm::length(normal);
+		if(length > 0.0f)
+		{
+			normals.push_back(normal / length);
+			axis += normal / length;
+		}
+	}
+
+	meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.coneCutoff = 1.0f;
+
+	float axisLength = glm::length(axis);
+	if(axisLength <= 0.0f)
+	{
+		return;
+	}
+	axis /= axisLength;
+
+	float minimumDot = 1.0f;
+	for(const auto& normal : normals)
+	{
+		minimumDot = std::min(minimumDot, glm::dot(normal, axis));
+	}
+
+	//Past roughly 84 degrees the test would hardly ever pass
+	if(minimumDot <= 0.1f)
+	{
+		return;
+	}
+
+	//Sine of the cone half angle, see MeshletRenderer for the test
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+}
+
+//Splits triangles (into mesh.vertices) into clusters in vertex cache order, appending them to mesh
+static void buildMeshlets(MeshletMesh& mesh, std::vector<uint32_t> indices, uint32_t level)
+{
+	//Compact the vertex range so the cache optimizer's tables stay proportional to the input
+	std::unordered_map<uint32_t, uint32_t> toLocal;
+	std::vector<uint32_t> toGlobal;
+	for(uint32_t& index : indices)
+	{
+		auto inserted = toLocal.emplace(index, static_cast<uint32_t>(toGlobal.size()));
+		if(inserted.second)
+		{
+			toGlobal.push_back(index);
+		}
+		index = inserted.first->second;
+	}
+
+	optimizeVertexCache(indices, static_cast<uint32_t>(toGlobal.size()));
+
+	Meshlet meshlet{};
+	auto flush = [&]()
+	{
+		if(meshlet.triangleCount == 0)
+		{
+			return;
+		}
+
+		computeBounds(mesh, meshlet);
+		meshlet.lodBounds = meshlet.bounds;
+		meshlet.lodError = 0.0f;
+		meshlet.parentBounds = meshlet.bounds;
+		meshlet.parentError = std::numeric_limits<float>::infinity();
+		meshlet.level = level;
+		mesh.meshlets.push_back(meshlet);
+
+		meshlet = Meshlet{};
+		meshlet.vertexOffset = static_cast<uint32_t>(mesh.meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(mesh.meshletTriangles.size());
+	};
+
+	meshlet.vertexOffset = static_cast<uint32_t>(mesh.meshletVertices.size());
+	meshlet.triangleOffset = static_cast<uint32_t>(mesh.meshletTriangles.size());
+
+	for(size_t t = 0; t < indices.size(); t += 3)
+	{
+		//At most 64 vertices, a linear search beats hashing
+		uint8_t local[3];
+		uint32_t newVertices = 0;
+		for(uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t global = toGlobal[indices[t + k]];
+			local[k] = 0xFF;
+			for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+			{
+				if(mesh.meshletVertices[meshlet.vertexOffset + i] == global)
+				{
+					local[k] = static_cast<uint8_t>(i);
+					break;
+				}
+			}
+
+			//The same new vertex can appear twice only in a degenerate triangle
+			if(local[k] == 0xFF)
+			{
+				newVertices++;
+			}
+		}
+
+		if(meshlet.vertexCount + newVertices > MESHLET_MAX_VERTICES || meshlet.triangleCount + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			flush();
+			for(auto& index : local)
+			{
+				index = 0xFF;
+			}
+		}
+
+		for(uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t global = toGlobal[indices[t + k]];
+			if(local[k] == 0xFF)
+			{
+				for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+				{
+					if(mesh.meshletVertices[meshlet.vertexOffset + i] == global)
+					{
+						local[k] = static_cast<uint8_t>(i);
+						break;
+					}
+				}
+			}
+
+			if(local[k] == 0xFF)
+			{
+				local[k] = static_cast<uint8_t>(meshlet.vertexCount++);
+				mesh.meshletVertices.push_back(global);
+			}
+			mesh.meshletTriangles.push_back(local[k]);
+		}
+		meshlet.triangleCount++;
+	}
+
+	flush();
+}
+
+//Symmetric 4x4 error quadric, stored as its upper triangle
+struct Quadric
+{
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	void addPlane(const glm::vec3& normal, float distance)
+	{
+		a00 += normal.x * normal.x; a01 += normal.x * normal.y; a02 += normal.x * normal.z;
+		a11 += normal.y * normal.y; a12 += normal.y * normal.z; a22 += normal.z * normal.z;
+		b0 += normal.x * distance; b1 += normal.y * distance; b2 += normal.z * distance;
+		c += distance * distance;
+		weight += 1;
+	}
+
+	void add(const Quadric& other)
+	{
+		a00 += other.a00; a01 += other.a01; a02 += other.a02;
+		a11 += other.a11; a12 += other.a12; a22 += other.a22;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	//Mean squared distance to the accumulated planes, so merged quadrics don't inflate the error
+	double evaluate(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z
+			+ a11 * y * y + 2 * a12 * y * z + a22 * z * z
+			+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0 ? std::max(result, 0.0) / weight : 0.0;
+	}
+};
+
+struct Collapse
+{
+	double cost;
+	uint32_t from;
+	uint32_t to;
+	uint32_t fromVersion;
+	uint32_t toVersion;
+
+	bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+//Quadric edge collapse onto existing vertices, so every level shares the source vertex buffer.
+//Locked vertices never move. Returns the largest collapse error as a distance
+static float simplify(const std::vector<glm::vec3>& positions, const std::vector<uint8_t>& locked,
+	std::vector<uint32_t>& indices, size_t targetTriangles)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(positions.size());
+	size_t triangleCount = indices.size() / 3;
+
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+	for(uint32_t t = 0; t < triangleCount; t++)
+	{
+		const glm::vec3& a = positions[indices[t * 3 + 0]];
+		glm::vec3 normal = triangleNormal(a, positions[indices[t * 3 + 1]], positions[indices[t * 3 + 2]]);
+		float length = glm::length(normal);
+		if(length > 0.0f)
+		{
+			normal /= length;
+		}
+
+		for(uint32_t k = 0; k < 3; k++)
+		{
+			quadrics[indices[t * 3 + k]].addPlane(normal, -glm::dot(normal, a));
+			vertexTriangles[indices[t * 3 + k]].push_back(t);
+		}
+	}
+
+	std::vector<uint8_t> alive(triangleCount, 1);
+	std::vector<uint8_t> removed(vertexCount, 0);
+	std::vector<uint32_t> version(vertexCount, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	auto pushEdge = [&](uint32_t a, uint32_t b)
+	{
+		Quadric combined = quadrics[a];
+		combined.add(quadrics[b]);
+
+		if(!locked[a])
+		{
+			queue.push({ combined.evaluate(positions[b]), a, b, version[a], version[b] });
+		}
+		if(!locked[b])
+		{
+			queue.push({ combined.evaluate(positions[a]), b, a, version[b], version[a] });
+		}
+	};
+
+	std::unordered_set<uint64_t> edges;
+	for(uint32_t t = 0; t < triangleCount; t++)
+	{
+		for(uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t a = indices[t * 3 + k];
+			uint32_t b = indices[t * 3 + (k + 1) % 3];
+			if(edges.insert(edgeKey(a, b)).second)
+			{
+				pushEdge(a, b);
+			}
+		}
+	}
+
+	double maxCost = 0.0;
+	size_t liveTriangles = triangleCount;
+	while(liveTriangles > targetTriangles && !queue.empty())
+	{
+		Collapse collapse = queue.top();
+		queue.pop();
+
+		if(removed[collapse.from] || removed[collapse.to]
+			|| version[collapse.from] != collapse.fromVersion || version[collapse.to] != collapse.toVersion)
+		{
+			continue;
+		}
+
+		//Reject collapses that would flip a surviving triangle
+		bool flips = false;
+		for(uint32_t t : vertexTriangles[collapse.from])
+		{
+			uint32_t* triangle = &indices[t * 3];
+			if(!alive[t] || triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+			{
+				continue;
+			}
+
+			glm::vec3 moved[3];
+			for(uint32_t k = 0; k < 3; k++)
+			{
+				moved[k] = positions[triangle[k] == collapse.from ? collapse.to : triangle[k]];
+			}
+
+			glm::vec3 before = triangleNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]]);
+			glm::vec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+			if(glm::dot(before, after) <= 0.0f)
+			{
+				flips = true;
+				break;
+			}
+		}
+
+		if(flips)
+		{
+			continue;
+		}
+
+		for(uint32_t t : vertexTriangles[collapse.from])
+		{
+			if(!alive[t])
+			{
+				continue;
+			}
+
+			uint32_t* triangle = &indices[t * 3];
+			if(triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+			{
+				alive[t] = 0;
+				liveTriangles--;
+				continue;
+			}
+
+			for(uint32_t k = 0; k < 3; k++)
+			{
+				if(triangle[k] == collapse.from)
+				{
+					triangle[k] = collapse.to;
+				}
+			}
+			vertexTriangles[collapse.to].push_back(t);
+		}
+
+		quadrics[collapse.to].add(quadrics[collapse.from]);
+		removed[collapse.from] = 1;
+		vertexTriangles[collapse.from].clear();
+		version[collapse.to]++;
+		maxCost = std::max(maxCost, collapse.cost);
+
+		//Every edge around the surviving vertex has a new cost
+		for(uint32_t t : vertexTriangles[collapse.to])
+		{
+			if(!alive[t])
+			{
+				continue;
+			}
+
+			for(uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t other = indices[t * 3 + k];
+				if(other != collapse.to)
+				{
+					pushEdge(collapse.to, other);
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(liveTriangles * 3);
+	for(uint32_t t = 0; t < triangleCount; t++)
+	{
+		if(alive[t])
+		{
+			result.insert(result.end(), &indices[t * 3], &indices[t * 3] + 3);
+		}
+	}
+	indices.swap(result);
+
+	return static_cast<float>(std::sqrt(maxCost));
+}
+
+//Greedily grows groups of up to GROUP_SIZE clusters along the edges they share
+static std::vector<std::vector<uint32_t>> groupMeshlets(const MeshletMesh& mesh, const std::vector<uint32_t>& active)
+{
+	std::unordered_map<uint64_t, uint32_t> edgeOwner;
+	std::vector<std::unordered_map<uint32_t, uint32_t>> sharedEdges(active.size());
+
+	for(uint32_t i = 0; i < active.size(); i++)
+	{
+		const Meshlet& meshlet = mesh.meshlets[active[i]];
+		const uint32_t* vertices = &mesh.meshletVertices[meshlet.vertexOffset];
+		const uint8_t* triangles = &mesh.meshletTriangles[meshlet.triangleOffset];
+
+		for(uint32_t t = 0; t < meshlet.triangleCount * 3; t += 3)
+		{
+			for(uint32_t k = 0; k < 3; k++)
+			{
+				uint64_t key = edgeKey(vertices[triangles[t + k]], vertices[triangles[t + (k + 1) % 3]]);
+				auto inserted = edgeOwner.emplace(key, i);
+				uint32_t owner = inserted.first->second;
+				if(!inserted.second && owner != i)
+				{
+					sharedEdges[i][owner]++;
+					sharedEdges[owner][i]++;
+				}
+			}
+		}
+	}
+
+	std::vector<std::vector<uint32_t>> groups;
+	std::vector<uint8_t> grouped(active.size(), 0);
+	for(uint32_t seed = 0; seed < active.size(); seed++)
+	{
+		if(grouped[seed])
+		{
+			continue;
+		}
+
+		std::vector<uint32_t> group = { seed };
+		grouped[seed] = 1;
+
+		std::unordered_map<uint32_t, uint32_t> candidates;
+		while(group.size() < GROUP_SIZE)
+		{
+			for(const auto& neighbour : sharedEdges[group.back()])
+			{
+				if(!grouped[neighbour.first])
+				{
+					candidates[neighbour.first] += neighbour.second;
+				}
+			}
+
+			uint32_t best = NO_GROUP;
+			uint32_t bestShared = 0;
+			for(const auto& candidate : candidates)
+			{
+				if(!grouped[candidate.first] && candidate.second > bestShared)
+				{
+					best = candidate.first;
+					bestShared = candidate.second;
+				}
+			}
+
+			if(best == NO_GROUP)
+			{
+				break;
+			}
+
+			group.push_back(best);
+			grouped[best] = 1;
+		}
+
+		for(auto& member : group)
+		{
+			member = active[member];
+		}
+		groups.push_back(std::move(group));
+	}
+
+	return groups;
+}
+
+MeshletMesh buildMeshletMesh(JobSystem& jobs, const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	MeshletMesh mesh;
+	mesh.vertices = vertices;
+
+	buildMeshlets(mesh, indices, 0);
+	mesh.levelCount = 1;
+
+	std::vector<uint32_t> active(mesh.meshlets.size());
+	for(uint32_t i = 0; i < active.size(); i++)
+	{
+		active[i] = i;
+	}
+
+	while(active.size() > 1)
+	{
+		std::vector<std::vector<uint32_t>> groups = groupMeshlets(mesh, active);
+
+		//Vertices touched by more than one group sit on a group border
+		std::vector<uint32_t> vertexGroup(vertices.size(), NO_GROUP);
+		for(uint32_t g = 0; g < groups.size(); g++)
+		{
+			for(uint32_t index : groups[g])
+			{
+				const Meshlet& meshlet = mesh.meshlets[index];
+				for(uint32_t i = 0; i < meshlet.vertexCount; i++)
+				{
+					uint32_t& owner = vertexGroup[mesh.meshletVertices[meshlet.vertexOffset + i]];
+					owner = owner == NO_GROUP || owner == g ? g : SHARED_VERTEX;
+				}
+			}
+		}
+
+		struct GroupResult
+		{
+			std::vector<uint32_t> indices;
+			glm::vec4 bounds;
+			float error;
+			bool simplified;
+		};
+		std::vector<GroupResult> results(groups.size());
+
+		jobs.parallelFor(static_cast<uint32_t>(groups.size()), 1, [&](uint32_t begin, uint32_t end)
+		{
+			for(uint32_t g = begin; g < end; g++)
+			{
+				GroupResult& result = results[g];
+
+				std::vector<glm::vec4> childBounds;
+				float childError = 0.0f;
+				std::unordered_map<uint32_t, uint32_t> toLocal;
+				std::vector<uint32_t> toGlobal;
+				std::vector<uint32_t> localIndices;
+				for(uint32_t index : groups[g])
+				{
+					const Meshlet& meshlet = mesh.meshlets[index];
+					childBounds.push_back(meshlet.lodBounds);
+					childError = std::max(childError, meshlet.lodError);
+
+					for(uint32_t t = 0; t < meshlet.triangleCount * 3; t++)
+					{
+						uint32_t global = mesh.meshletVertices[meshlet.vertexOffset + mesh.meshletTriangles[meshlet.triangleOffset + t]];
+						auto inserted = toLocal.emplace(global, static_cast<uint32_t>(toGlobal.size()));
+						if(inserted.second)
+						{
+							toGlobal.push_back(global);
+						}
+						localIndices.push_back(inserted.first->second);
+					}
+				}
+
+				std::vector<glm::vec3> positions(toGlobal.size());
+				std::vector<uint8_t> locked(toGlobal.size());
+				for(uint32_t i = 0; i < toGlobal.size(); i++)
+				{
+					positions[i] = vertices[toGlobal[i]].position;
+					locked[i] = vertexGroup[toGlobal[i]] == SHARED_VERTEX;
+				}
+
+				//Open edges of the source mesh have to stay put too
+				std::unordered_map<uint64_t, uint32_t> edgeUse;
+				for(size_t t = 0; t < localIndices.size(); t += 3)
+				{
+					for(uint32_t k = 0; k < 3; k++)
+					{
+						edgeUse[edgeKey(localIndices[t + k], localIndices[t + (k + 1) % 3])]++;
+					}
+				}
+				for(const auto& edge : edgeUse)
+				{
+					if(edge.second == 1)
+					{
+						locked[edge.first >> 32] = 1;
+						locked[edge.first & 0xFFFFFFFF] = 1;
+					}
+				}
+
+				size_t sourceTriangles = localIndices.size() / 3;
+				float error = simplify(positions, locked, localIndices, sourceTriangles / 2);
+
+				result.simplified = localIndices.size() / 3 <= sourceTriangles * MIN_REDUCTION;
+				result.error = childError + error;
+				result.bounds = mergeSpheres(childBounds);
+
+				result.indices.resize(localIndices.size());
+				for(size_t i = 0; i < localIndices.size(); i++)
+				{
+					result.indices[i] = toGlobal[localIndices[i]];
+				}
+			}
+		});
+
+		std::vector<uint32_t> nextActive;
+		bool anySimplified = false;
+		for(uint32_t g = 0; g < groups.size(); g++)
+		{
+			const GroupResult& result = results[g];
+
+			//Mostly locked border, try again next level with different neighbours
+			if(!result.simplified)
+			{
+				nextActive.insert(nextActive.end(), groups[g].begin(), groups[g].end());
+				continue;
+			}
+			anySimplified = true;
+
+			for(uint32_t index : groups[g])
+			{
+				mesh.meshlets[index].parentBounds = result.bounds;
+				mesh.meshlets[index].parentError = result.error;
+			}
+
+			size_t first = mesh.meshlets.size();
+			buildMeshlets(mesh, result.indices, mesh.levelCount);
+			for(size_t i = first; i < mesh.meshlets.size(); i++)
+			{
+				mesh.meshlets[i].lodBounds = result.bounds;
+				mesh.meshlets[i].lodError = result.error;
+				nextActive.push_back(static_cast<uint32_t>(i));
+			}
+		}
+
+		//Whatever is still active becomes a root
+		if(!anySimplified)
+		{
+			break;
+		}
+
+		active.swap(nextActive);
+		mesh.levelCount++;
+	}
+
+	return mesh;
+}
+
+template<typename T>
+static void writeArray(std::ofstream& file, const std::vector<T>& data)
+{
+	uint64_t count = data.size();
+	file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	file.write(reinterpret_cast<const char*>(data.data()), sizeof(T) * count);
+}
+
+template<typename T>
+static bool readArray(std::ifstream& file, std::vector<T>& data)
+{
+	uint64_t count = 0;
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if(!file)
+	{
+		return false;
+	}
+
+	//A corrupt count could ask for any amount of memory, it has to fit in what is left of the file
+	std::streampos position = file.tellg();
+	file.seekg(0, std::ios::end);
+	std::streamoff remaining = file.tellg() - position;
+	file.seekg(position);
+	if(!file || count > static_cast<uint64_t>(remaining) / sizeof(T))
+	{
+		return false;
+	}
+
+	data.resize(count);
+	file.read(reinterpret_cast<char*>(data.data()), sizeof(T) * count);
+	return static_cast<bool>(file);
+}
+
+//Every range a cluster points at has to exist, the renderer indexes with them unchecked
+static bool validMeshletMesh(const MeshletMesh& mesh)
+{
+	for(const Meshlet& meshlet : mesh.meshlets)
+	{
+		if(static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > mesh.meshletVertices.size()
+			|| static_cast<uint64_t>(meshlet.triangleOffset) + static_cast<uint64_t>(meshlet.triangleCount) * 3 > mesh.meshletTriangles.size())
+		{
+			return false;
+		}
+	}
+
+	return std::all_of(mesh.meshletVertices.begin(), mesh.meshletVertices.end(),
+		[&mesh](uint32_t vertex) { return vertex < mesh.vertices.size(); });
+}
+
+bool loadMeshletMesh(const std::string& filename, MeshletMesh& mesh)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	uint32_t header[3] = {};
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if(!file || header[0] != FILE_MAGIC || header[1] != FILE_VERSION)
+	{
+		return false;
+	}
+
+	//Truncated or corrupt, e.g. from a run killed halfway through an older save, is just a miss
+	MeshletMesh loaded;
+	loaded.levelCount = header[2];
+	if(!readArray(file, loaded.vertices) || !readArray(file, loaded.meshlets)
+		|| !readArray(file, loaded.meshletVertices) || !readArray(file, loaded.meshletTriangles)
+		|| !validMeshletMesh(loaded))
+	{
+		return false;
+	}
+
+	mesh = std::move(loaded);
+	return true;
+}
+
+bool saveMeshletMesh(const std::string& filename, const MeshletMesh& mesh)
+{
+	//Written beside the real file and renamed over it, so a save that dies halfway never leaves a short cache
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		if(!file.is_open())
+		{
+			return false;
+		}
+
+		uint32_t header[3] = { FILE_MAGIC, FILE_VERSION, mesh.levelCount };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		writeArray(file, mesh.vertices);
+		writeArray(file, mesh.meshlets);
+		writeArray(file, mesh.meshletVertices);
+		writeArray(file, mesh.meshletTriangles);
+		file.close();
+		if(!file)
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	//Windows won't rename onto an existing file. Only a stale or corrupt cache gets replaced, losing it is fine
+	if(std::rename(temporary.c_str(), filename.c_str()) != 0)
+	{
+		std::remove(filename.c_str());
+		if(std::rename(temporary.c_str(), filename.c_str()) != 0)
+		{
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+void generateTorusKnot(uint32_t segments, uint32_t sides, std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices)
+{
+	const float tau = 6.2831853f;
+	const float tubeRadius = 0.12f;
+
+	auto curve = [](float t)
+	{
+		float r = 0.3f * (2.0f + std::cos(3.0f * t));
+		return glm::vec3(r * std::cos(2.0f * t), r * std::sin(2.0f * t), 0.3f * std::sin(3.0f * t));
+	};
+
+	vertices.resize(segments * sides);
+	for(uint32_t i = 0; i < segments; i++)
+	{
+		//Frenet frame from finite differences, the knot's curvature never vanishes
+		float t = tau * i / segments;
+		float step = tau / segments;
+		glm::vec3 center = curve(t);
+		glm::vec3 previous = curve(t - step);
+		glm::vec3 next = curve(t + step);
+
+		glm::vec3 tangent = glm::normalize(next - previous);
+		glm::vec3 normal = glm::normalize(next + previous - 2.0f * center);
+		glm::vec3 binormal = glm::cross(tangent, normal);
+
+		for(uint32_t j = 0; j < sides; j++)
+		{
+			float angle = tau * j / sides;
+			glm::vec3 direction = std::cos(angle) * normal + std::sin(angle) * binormal;
+			vertices[i * sides + j] = { center + direction * tubeRadius, direction };
+		}
+	}
+
+	//Counter-clockwise seen from outside
+	indices.clear();
+	indices.reserve(segments * sides * 6);
+	for(uint32_t i = 0; i < segments; i++)
+	{
+		for(uint32_t j = 0; j < sides; j++)
+		{
+			uint32_t a = i * sides + j;
+			uint32_t b = ((i + 1) % segments) * sides + j;
+			uint32_t c = ((i + 1) % segments) * sides + (j + 1) % sides;
+			uint32_t d = i * sides + (j + 1) % sides;
+			indices.insert(indices.end(), { a, c, b, a, d, c });
+		}
+	}
+}
+
+MeshletMesh buildDemoMeshletMesh(JobSystem& jobs)
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	generateTorusKnot(4096, 128, vertices, indices);
+	return buildMeshletMesh(jobs, vertices, indices);
+}
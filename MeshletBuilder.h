@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class JobSystem;
+
+struct MeshVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+};
+
+//Same limits a mesh shader path would use, so the clusters carry over
+static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	//Into MeshletMesh::meshletVertices, and meshletTriangles at 3 bytes per triangle
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+
+	//Culling: bounding sphere and normal cone, a cutoff of 1 means the cone is too wide to ever cull
+	glm::vec4 bounds;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+
+	//LOD: this cluster's error measured over lodBounds, and the same for the coarser clusters replacing it.
+	//Both are shared by every cluster from the same group, which keeps the chosen cut free of cracks
+	glm::vec4 lodBounds;
+	glm::vec4 parentBounds;
+	float lodError;
+	float parentError;
+
+	uint32_t level;
+};
+
+//Every level lives side by side, all indexing into the one vertex array
+struct MeshletMesh
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint8_t> meshletTriangles;
+	uint32_t levelCount = 0;
+};
+
+//Tipsify: reorders triangles in place for post-transform vertex cache reuse
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = 16);
+
+//Level 0 splits the source triangles into clusters. Each further level groups neighbouring clusters,
+//simplifies every group to half its triangles with the group border locked, and splits it again
+MeshletMesh buildMeshletMesh(JobSystem& jobs, const std::vector<MeshVertex>& vertices, const std::vector<uint32_t>& indices);
+
+//Returns false when the file is missing, truncated, corrupt or was written by a different version of the builder
+bool loadMeshletMesh(const std::string& filename, MeshletMesh& mesh);
+//Returns false when the file couldn't be written, nothing is left behind in that case
+bool saveMeshletMesh(const std::string& filename, const MeshletMesh& mesh);
+
+//Stand-in for CAD data, a (2, 3) torus knot tessellated as finely as asked
+void generateTorusKnot(uint32_t segments, uint32_t sides, std::vector<MeshVertex>& vertices, std::vector<uint32_t>& indices);
+
+//The demo mesh is built offline with --build-meshlets, or on first start, and cached here
+static constexpr const char* DEMO_MESHLET_FILE = "knot.meshlets";
+
+//The torus knot at about a million triangles
+MeshletMesh buildDemoMeshletMesh(JobSystem& jobs);
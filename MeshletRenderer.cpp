@@ -0,0 +1,822 @@
+#include "MeshletRenderer.h"
+#include "JobSystem.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <stdexcept>
+
+//Matches Candidate in meshlet_cull.comp
+struct MeshletCandidate
+{
+	glm::vec4 bounds;
+	uint32_t meshlet;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t padding;
+};
+
+//Matches the push constant block in meshlet_cull.comp, viewports are x, y, width, height in pixels
+struct CullPushConstants
+{
+	glm::vec4 viewports[MAX_RENDER_VIEWS];
+	uint32_t candidateCount;
+	uint32_t viewCount;
+	uint32_t phase;
+	uint32_t candidateBase;
+	uint32_t viewBase;
+	uint32_t commandBase;
+	uint32_t statsBase;
+};
+
+//Must match meshlet_cull.comp
+static constexpr uint32_t CULL_EARLY = 0;
+static constexpr uint32_t CULL_LATE = 1;
+static constexpr uint32_t CULL_ALL = 2;
+static constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+static constexpr uint32_t STATS_COUNTERS = 4;
+
+static constexpr uint32_t REDUCE_WORKGROUP_SIZE = 8;
+
+enum MeshletSelection : uint8_t
+{
+	SELECTION_WRONG_LOD,
+	SELECTION_FRUSTUM_CULLED,
+	SELECTION_BACKFACE_CULLED,
+	SELECTION_DRAWN
+};
+
+//Error in pixels as seen from the camera, measured at the nearest point of the bounds
+static float projectedError(const glm::vec4& bounds, float error, const Camera& camera)
+{
+	float distance = glm::length(glm::vec3(bounds) - camera.position) - bounds.w;
+	distance = std::max(distance, camera.nearPlane);
+	return error / distance * camera.projectionScale;
+}
+
+static uint32_t nextPowerOfTwo(uint32_t value)
+{
+	uint32_t power = 1;
+	while(power < value)
+	{
+		power *= 2;
+	}
+	return power;
+}
+
+//Every triangle in the cluster faces away from anywhere the camera could see it from
+static bool coneCulled(const Meshlet& meshlet, const Camera& camera)
+{
+	glm::vec3 offset = glm::vec3(meshlet.bounds) - camera.position;
+	return glm::dot(offset, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(offset) + meshlet.bounds.w;
+}
+
+void MeshletRenderer::initialize(const MeshletRendererInfo& createInfo, const MeshletMesh& mesh)
+{
+	info = createInfo;
+	meshlets = mesh.meshlets;
+
+	//No mesh shaders here, so the micro indices become a regular index buffer
+	std::vector<uint32_t> indices;
+	indices.reserve(mesh.meshletTriangles.size());
+	firstIndices.resize(meshlets.size());
+	sourceTriangles = 0;
+	for(size_t i = 0; i < meshlets.size(); i++)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		firstIndices[i] = static_cast<uint32_t>(indices.size());
+		for(uint32_t t = 0; t < meshlet.triangleCount * 3; t++)
+		{
+			indices.push_back(mesh.meshletVertices[meshlet.vertexOffset + mesh.meshletTriangles[meshlet.triangleOffset + t]]);
+		}
+
+		if(meshlet.level == 0)
+		{
+			sourceTriangles += meshlet.triangleCount;
+		}
+	}
+
+	vertexBuffer = createDeviceLocalBuffer(info.physicalDevice, info.device, info.queue, info.commandPool,
+		mesh.vertices.data(), sizeof(MeshVertex) * mesh.vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	indexBuffer = createDeviceLocalBuffer(info.physicalDevice, info.device, info.queue, info.commandPool,
+		indices.data(), sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	const VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	candidateBuffer = createBuffer(info.physicalDevice, info.device, sizeof(MeshletCandidate) * meshlets.size() * info.framesInFlight,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+	candidates = static_cast<MeshletCandidate*>(candidateBuffer.mapped);
+
+	indirectBuffer = createBuffer(info.physicalDevice, info.device,
+		sizeof(VkDrawIndexedIndirectCommand) * meshlets.size() * MAX_RENDER_VIEWS * 2 * info.framesInFlight,
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	viewBuffer = createBuffer(info.physicalDevice, info.device, sizeof(glm::mat4) * MAX_RENDER_VIEWS * info.framesInFlight,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible);
+	viewMatrices = static_cast<glm::mat4*>(viewBuffer.mapped);
+
+	//Nothing was visible before the first frame, it all goes through the late pass
+	std::vector<uint32_t> visibility(meshlets.size() * MAX_RENDER_VIEWS, 0);
+	visibilityBuffer = createDeviceLocalBuffer(info.physicalDevice, info.device, info.queue, info.commandPool,
+		visibility.data(), sizeof(uint32_t) * visibility.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	statsBuffer = createBuffer(info.physicalDevice, info.device, sizeof(uint32_t) * STATS_COUNTERS * info.framesInFlight,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, hostVisible);
+	statsCounters = static_cast<const uint32_t*>(statsBuffer.mapped);
+
+	selection.resize(meshlets.size());
+	selected.reserve(meshlets.size());
+	pending.assign(info.framesInFlight, PendingResults{});
+
+	createOcclusionResources();
+	createPipelineLayouts();
+}
+
+void MeshletRenderer::createOcclusionResources()
+{
+	//Only ever read with texelFetch, the sampler is there because combined image samplers need one
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+	if(vkCreateSampler(info.device, &samplerInfo, nullptr, pyramidSampler.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+	}
+
+	//Reduce: the level above (or the depth buffer) in, one level out
+	VkDescriptorSetLayoutBinding reduceBindings[2]{};
+	reduceBindings[0].binding = 0;
+	reduceBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	reduceBindings[0].descriptorCount = 1;
+	reduceBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reduceBindings[1].binding = 1;
+	reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	reduceBindings[1].descriptorCount = 1;
+	reduceBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = reduceBindings;
+
+	if(vkCreateDescriptorSetLayout(info.device, &layoutInfo, nullptr, reduceSetLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth reduce descriptor set layout!");
+	}
+
+	//Cull: candidates, views, visibility, commands and stats, then the whole pyramid
+	VkDescriptorSetLayoutBinding cullBindings[6]{};
+	for(uint32_t i = 0; i < 6; i++)
+	{
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = i < 5 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	layoutInfo.bindingCount = 6;
+	layoutInfo.pBindings = cullBindings;
+
+	if(vkCreateDescriptorSetLayout(info.device, &layoutInfo, nullptr, cullSetLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet cull descriptor set layout!");
+	}
+
+	//Timing is optional, the culling itself works without it
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(info.physicalDevice, &properties);
+	if(!properties.limits.timestampComputeAndGraphics)
+	{
+		return;
+	}
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * info.framesInFlight;
+
+	if(vkCreateQueryPool(info.device, &queryPoolInfo, nullptr, queryPool.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet query pool!");
+	}
+}
+
+void MeshletRenderer::createPipelineLayouts()
+{
+	//Cameras come in as instance data, there is nothing else to bind
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+	if(vkCreatePipelineLayout(info.device, &pipelineLayoutInfo, nullptr, pipelineLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet pipeline layout!");
+	}
+
+	VkPipelineLayoutCreateInfo reduceLayoutInfo{};
+	reduceLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	reduceLayoutInfo.setLayoutCount = 1;
+	reduceLayoutInfo.pSetLayouts = reduceSetLayout.address();
+
+	if(vkCreatePipelineLayout(info.device, &reduceLayoutInfo, nullptr, reduceLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth reduce pipeline layout!");
+	}
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(CullPushConstants);
+
+	VkPipelineLayoutCreateInfo cullLayoutInfo{};
+	cullLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	cullLayoutInfo.setLayoutCount = 1;
+	cullLayoutInfo.pSetLayouts = cullSetLayout.address();
+	cullLayoutInfo.pushConstantRangeCount = 1;
+	cullLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if(vkCreatePipelineLayout(info.device, &cullLayoutInfo, nullptr, cullLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet cull pipeline layout!");
+	}
+}
+
+PipelineDesc MeshletRenderer::drawPipelineDesc() const
+{
+	//Two variants of one pipeline. The multi-viewport shader writes gl_ViewportIndex, a capability the device
+	//has to support before it can even load the module, so that choice can't be a specialization constant
+	PipelineDesc desc{};
+	desc.vertexShader = info.multiViewport ? "meshlet_views_vert.spv" : "meshlet_vert.spv";
+	desc.fragmentShader = "meshlet_frag.spv";
+	desc.layout = pipelineLayout;
+
+	//Binding 1 steps once per instance, which is once per view
+	VkVertexInputBindingDescription bindings[2]{};
+	bindings[0].binding = 0;
+	bindings[0].stride = sizeof(MeshVertex);
+	bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	bindings[1].binding = 1;
+	bindings[1].stride = sizeof(glm::mat4);
+	bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	desc.bindings.assign(bindings, bindings + 2);
+
+	//The view-projection matrix takes one location per column
+	VkVertexInputAttributeDescription attributes[6]{};
+	attributes[0].binding = 0;
+	attributes[0].location = 0;
+	attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[0].offset = offsetof(MeshVertex, position);
+	attributes[1].binding = 0;
+	attributes[1].location = 1;
+	attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[1].offset = offsetof(MeshVertex, normal);
+	for(uint32_t column = 0; column < 4; column++)
+	{
+		attributes[2 + column].binding = 1;
+		attributes[2 + column].location = 2 + column;
+		attributes[2 + column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributes[2 + column].offset = sizeof(glm::vec4) * column;
+	}
+	desc.attributes.assign(attributes, attributes + 6);
+
+	//recordDraw sets all of them every time, views beyond the frame's count repeat the last one
+	desc.viewportCount = info.multiViewport ? MAX_RENDER_VIEWS : 1;
+
+	//The projection flips y, so counter-clockwise meshes stay counter-clockwise on screen
+	desc.cullMode = VK_CULL_MODE_BACK_BIT;
+	desc.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	desc.depthTest = true;
+	desc.depthWrite = true;
+	desc.depthCompare = VK_COMPARE_OP_LESS;
+	desc.blend = BlendMode::Opaque;
+	return desc;
+}
+
+void MeshletRenderer::addPipelines(std::vector<PipelineDesc>& manifest) const
+{
+	manifest.push_back(drawPipelineDesc());
+
+	PipelineDesc reduce{};
+	reduce.computeShader = "depth_reduce_comp.spv";
+	reduce.layout = reduceLayout;
+	manifest.push_back(reduce);
+
+	PipelineDesc cull{};
+	cull.computeShader = "meshlet_cull_comp.spv";
+	cull.layout = cullLayout;
+	manifest.push_back(cull);
+}
+
+void MeshletRenderer::createPipelines(PipelineLibrary& library)
+{
+	std::vector<PipelineDesc> descs;
+	addPipelines(descs);
+	pipeline = library.get(descs[0]);
+	reducePipeline = library.get(descs[1]);
+	cullPipeline = library.get(descs[2]);
+}
+
+DepthPyramid MeshletRenderer::setDepthTarget(VkImage image, VkImageView view, VkExtent2D extent)
+{
+	DepthPyramid next{};
+	next.extent.width = nextPowerOfTwo((extent.width + 1) / 2);
+	next.extent.height = nextPowerOfTwo((extent.height + 1) / 2);
+
+	uint32_t levelCount = 1;
+	while((std::max(next.extent.width, next.extent.height) >> levelCount) > 0)
+	{
+		levelCount++;
+	}
+
+	next.image = createImage(info.physicalDevice, info.device, next.extent, VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, levelCount);
+
+	//Each reduce step reads one level and writes the next
+	next.levelViews.resize(levelCount);
+	for(uint32_t level = 0; level < levelCount; level++)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = next.image.image;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = level;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if(vkCreateImageView(info.device, &viewInfo, nullptr, next.levelViews[level].put(info.device)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid level view!");
+		}
+	}
+
+	VkDescriptorPoolSize poolSizes[3]{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = levelCount + 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = levelCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 5;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = poolSizes;
+	poolInfo.maxSets = levelCount + 1;
+
+	if(vkCreateDescriptorPool(info.device, &poolInfo, nullptr, next.descriptorPool.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor pool!");
+	}
+
+	std::vector<VkDescriptorSetLayout> layouts(levelCount, reduceSetLayout.get());
+	layouts.push_back(cullSetLayout.get());
+
+	std::vector<VkDescriptorSet> sets(levelCount + 1);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = next.descriptorPool;
+	allocInfo.descriptorSetCount = levelCount + 1;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if(vkAllocateDescriptorSets(info.device, &allocInfo, sets.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+	}
+	next.reduceSets.assign(sets.begin(), sets.begin() + levelCount);
+	next.cullSet = sets.back();
+
+	//Sized up front, the writes point into them
+	std::vector<VkDescriptorImageInfo> imageInfos(levelCount * 2 + 1);
+	std::vector<VkWriteDescriptorSet> writes;
+	writes.reserve(levelCount * 2 + 6);
+	for(uint32_t level = 0; level < levelCount; level++)
+	{
+		VkDescriptorImageInfo& source = imageInfos[level * 2];
+		source.sampler = pyramidSampler;
+		source.imageView = level == 0 ? view : next.levelViews[level - 1].get();
+		source.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo& destination = imageInfos[level * 2 + 1];
+		destination.imageView = next.levelViews[level];
+		destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = next.reduceSets[level];
+		write.descriptorCount = 1;
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &source;
+		writes.push_back(write);
+
+		write.dstBinding = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.pImageInfo = &destination;
+		writes.push_back(write);
+	}
+
+	//Whole buffers, the frame slices are picked with push constants
+	VkDescriptorBufferInfo bufferInfos[5]{};
+	VkBuffer buffers[5] = { candidateBuffer.buffer, viewBuffer.buffer, visibilityBuffer.buffer, indirectBuffer.buffer, statsBuffer.buffer };
+	for(uint32_t binding = 0; binding < 5; binding++)
+	{
+		bufferInfos[binding].buffer = buffers[binding];
+		bufferInfos[binding].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = next.cullSet;
+		write.dstBinding = binding;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfos[binding];
+		writes.push_back(write);
+	}
+
+	VkDescriptorImageInfo& pyramidInfo = imageInfos.back();
+	pyramidInfo.sampler = pyramidSampler;
+	pyramidInfo.imageView = next.image.view;
+	pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet pyramidWrite{};
+	pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	pyramidWrite.dstSet = next.cullSet;
+	pyramidWrite.dstBinding = 5;
+	pyramidWrite.descriptorCount = 1;
+	pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidWrite.pImageInfo = &pyramidInfo;
+	writes.push_back(pyramidWrite);
+
+	vkUpdateDescriptorSets(info.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+	depthImage = image;
+	std::swap(pyramid, next);
+	return next;
+}
+
+void MeshletRenderer::collectResults(uint32_t frameIndex)
+{
+	PendingResults& results = pending[frameIndex];
+	if(!results.recorded)
+	{
+		return;
+	}
+	results.recorded = false;
+
+	const uint32_t* counters = statsCounters + STATS_COUNTERS * frameIndex;
+	if(results.occlusion)
+	{
+		totalTested += counters[0];
+		totalOccluded += counters[1];
+		occludedFraction = counters[0] > 0 ? static_cast<float>(counters[1]) / counters[0] : 0.0f;
+	}
+	else
+	{
+		occludedFraction = 0.0f;
+	}
+
+	if(!queryPool)
+	{
+		return;
+	}
+
+	//The fence has signaled, so there is no waiting here
+	uint64_t timestamps[2];
+	if(vkGetQueryPoolResults(info.device, queryPool, 2 * frameIndex, 2, sizeof(timestamps), timestamps,
+		sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		double milliseconds = static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod / 1.0e6;
+		gpuTime[results.occlusion ? 1 : 0].add(milliseconds);
+	}
+}
+
+void MeshletRenderer::select(JobSystem& jobs, const RenderView* views, uint32_t viewCount)
+{
+	jobs.parallelFor(static_cast<uint32_t>(meshlets.size()), 256, [this, views, viewCount](uint32_t begin, uint32_t end)
+	{
+		for(uint32_t i = begin; i < end; i++)
+		{
+			//The largest error over all views is still monotonic up the hierarchy, so this stays one crack-free cut
+			const Meshlet& meshlet = meshlets[i];
+			float error = 0.0f;
+			float parentError = 0.0f;
+			bool inFrustum = false;
+			bool frontFacing = false;
+			for(uint32_t view = 0; view < viewCount; view++)
+			{
+				const Camera& camera = views[view].camera;
+				error = std::max(error, projectedError(meshlet.lodBounds, meshlet.lodError, camera));
+				parentError = std::max(parentError, projectedError(meshlet.parentBounds, meshlet.parentError, camera));
+				inFrustum = inFrustum || camera.sphereVisible(meshlet.bounds);
+				frontFacing = frontFacing || !coneCulled(meshlet, camera);
+			}
+
+			//Exactly one cut: fine enough itself, but the coarser replacement isn't
+			if(error > errorThreshold || parentError <= errorThreshold)
+			{
+				selection[i] = SELECTION_WRONG_LOD;
+			}
+			else if(!inFrustum)
+			{
+				selection[i] = SELECTION_FRUSTUM_CULLED;
+			}
+			else if(!frontFacing)
+			{
+				selection[i] = SELECTION_BACKFACE_CULLED;
+			}
+			else
+			{
+				selection[i] = SELECTION_DRAWN;
+			}
+		}
+	});
+
+	stats = MeshletStats{};
+	selected.clear();
+	for(uint32_t i = 0; i < selection.size(); i++)
+	{
+		switch(selection[i])
+		{
+		case SELECTION_FRUSTUM_CULLED:
+			stats.frustumCulled++;
+			break;
+		case SELECTION_BACKFACE_CULLED:
+			stats.backfaceCulled++;
+			break;
+		case SELECTION_DRAWN:
+			selected.push_back(i);
+			stats.drawn++;
+			stats.trianglesDrawn += meshlets[i].triangleCount;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void MeshletRenderer::writeDraws(uint32_t frameIndex, const RenderView* views, uint32_t viewCount)
+{
+	glm::mat4* matrices = viewMatrices + MAX_RENDER_VIEWS * frameIndex;
+	for(uint32_t view = 0; view < viewCount; view++)
+	{
+		matrices[view] = views[view].camera.viewProjection;
+	}
+
+	//The cull shader turns each candidate into one draw per view
+	MeshletCandidate* frameCandidates = candidates + meshlets.size() * frameIndex;
+	for(size_t i = 0; i < selected.size(); i++)
+	{
+		uint32_t index = selected[i];
+		frameCandidates[i].bounds = meshlets[index].bounds;
+		frameCandidates[i].meshlet = index;
+		frameCandidates[i].indexCount = meshlets[index].triangleCount * 3;
+		frameCandidates[i].firstIndex = firstIndices[index];
+		frameCandidates[i].padding = 0;
+	}
+}
+
+VkDeviceSize MeshletRenderer::commandOffset(uint32_t frameIndex, DrawPhase phase) const
+{
+	VkDeviceSize run = static_cast<VkDeviceSize>(frameIndex) * 2 + (phase == DrawPhase::Late ? 1 : 0);
+	return sizeof(VkDrawIndexedIndirectCommand) * meshlets.size() * MAX_RENDER_VIEWS * run;
+}
+
+void MeshletRenderer::recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount, uint32_t phase)
+{
+	CullPushConstants pushConstants{};
+	for(uint32_t view = 0; view < viewCount; view++)
+	{
+		const VkViewport& viewport = views[view].viewport;
+		pushConstants.viewports[view] = glm::vec4(viewport.x, viewport.y, viewport.width, viewport.height);
+	}
+	pushConstants.candidateCount = static_cast<uint32_t>(selected.size());
+	pushConstants.viewCount = viewCount;
+	pushConstants.phase = phase;
+	pushConstants.candidateBase = static_cast<uint32_t>(meshlets.size() * frameIndex);
+	pushConstants.viewBase = MAX_RENDER_VIEWS * frameIndex;
+	pushConstants.commandBase = static_cast<uint32_t>(commandOffset(frameIndex, phase == CULL_LATE ? DrawPhase::Late : DrawPhase::Early)
+		/ sizeof(VkDrawIndexedIndirectCommand));
+	pushConstants.statsBase = STATS_COUNTERS * frameIndex;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &pyramid.cullSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, (pushConstants.candidateCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, viewCount, 1);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void MeshletRenderer::recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount)
+{
+	//Opens the span recordDraw closes at the end of the late pass
+	if(queryPool)
+	{
+		vkCmdResetQueryPool(commandBuffer, queryPool, 2 * frameIndex, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 2 * frameIndex);
+	}
+
+	vkCmdFillBuffer(commandBuffer, statsBuffer.buffer, sizeof(uint32_t) * STATS_COUNTERS * frameIndex, sizeof(uint32_t) * STATS_COUNTERS, 0);
+
+	//The counters were just cleared, and last frame's late cull wrote the visibility read here
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	//The rest of the frame goes by what was decided here, even if the toggle flips halfway
+	pending[frameIndex].recorded = true;
+	pending[frameIndex].occlusion = occlusionCulling;
+
+	recordCull(commandBuffer, frameIndex, views, viewCount, occlusionCulling ? CULL_EARLY : CULL_ALL);
+}
+
+void MeshletRenderer::recordPyramid(VkCommandBuffer commandBuffer)
+{
+	uint32_t levelCount = static_cast<uint32_t>(pyramid.levelViews.size());
+
+	//Depth goes from attachment to sampled. The pyramid is rebuilt from scratch, but last frame's late cull
+	//may still be reading it
+	VkImageMemoryBarrier barriers[2]{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = depthImage;
+	barriers[0].subresourceRange.aspectMask = depthAspects(info.depthFormat);
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.layerCount = 1;
+
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = pyramid.image.image;
+	barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[1].subresourceRange.levelCount = levelCount;
+	barriers[1].subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reducePipeline);
+	for(uint32_t level = 0; level < levelCount; level++)
+	{
+		uint32_t width = std::max(pyramid.extent.width >> level, 1u);
+		uint32_t height = std::max(pyramid.extent.height >> level, 1u);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, reduceLayout, 0, 1, &pyramid.reduceSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (width + REDUCE_WORKGROUP_SIZE - 1) / REDUCE_WORKGROUP_SIZE,
+			(height + REDUCE_WORKGROUP_SIZE - 1) / REDUCE_WORKGROUP_SIZE, 1);
+
+		//The next level reads this one, the late cull reads them all
+		VkImageMemoryBarrier levelBarrier{};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		levelBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		levelBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		levelBarrier.image = pyramid.image.image;
+		levelBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		levelBarrier.subresourceRange.baseMipLevel = level;
+		levelBarrier.subresourceRange.levelCount = 1;
+		levelBarrier.subresourceRange.layerCount = 1;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+	}
+
+	//Back to an attachment for the late pass
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, barriers);
+}
+
+void MeshletRenderer::recordLateCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount)
+{
+	//With occlusion culling off the early pass drew everything already
+	if(!pending[frameIndex].recorded || !pending[frameIndex].occlusion)
+	{
+		return;
+	}
+
+	recordPyramid(commandBuffer);
+	recordCull(commandBuffer, frameIndex, views, viewCount, CULL_LATE);
+}
+
+void MeshletRenderer::recordIndirect(VkCommandBuffer commandBuffer, VkDeviceSize offset, uint32_t count)
+{
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	if(info.multiDrawIndirect)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.buffer, offset, count, stride);
+		return;
+	}
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.buffer, offset + stride * i, 1, stride);
+	}
+}
+
+void MeshletRenderer::recordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount, DrawPhase phase)
+{
+	const PendingResults& frame = pending[frameIndex];
+	bool draws = frame.recorded && (phase == DrawPhase::Early || frame.occlusion);
+	if(draws && !selected.empty() && viewCount > 0)
+	{
+		//Instance v reads matrix v of this frame's slice, so one bind covers every view
+		VkDeviceSize vertexOffset = 0;
+		VkDeviceSize viewOffset = sizeof(glm::mat4) * MAX_RENDER_VIEWS * frameIndex;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffer.buffer.address(), &vertexOffset);
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, viewBuffer.buffer.address(), &viewOffset);
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		//Commands are laid out view after view, candidateCount each
+		uint32_t candidateCount = static_cast<uint32_t>(selected.size());
+		VkDeviceSize offset = commandOffset(frameIndex, phase);
+		if(info.multiViewport)
+		{
+			VkViewport viewports[MAX_RENDER_VIEWS];
+			VkRect2D scissors[MAX_RENDER_VIEWS];
+			for(uint32_t view = 0; view < MAX_RENDER_VIEWS; view++)
+			{
+				const RenderView& source = views[std::min(view, viewCount - 1)];
+				viewports[view] = source.viewport;
+				scissors[view] = source.scissor;
+			}
+			vkCmdSetViewport(commandBuffer, 0, MAX_RENDER_VIEWS, viewports);
+			vkCmdSetScissor(commandBuffer, 0, MAX_RENDER_VIEWS, scissors);
+
+			//The whole grid in one go, the draws are recorded once however many views there are
+			recordIndirect(commandBuffer, offset, candidateCount * viewCount);
+		}
+		else
+		{
+			for(uint32_t view = 0; view < viewCount; view++)
+			{
+				vkCmdSetViewport(commandBuffer, 0, 1, &views[view].viewport);
+				vkCmdSetScissor(commandBuffer, 0, 1, &views[view].scissor);
+				recordIndirect(commandBuffer, offset + sizeof(VkDrawIndexedIndirectCommand) * candidateCount * view, candidateCount);
+			}
+		}
+	}
+
+	//Closes the span recordEarlyCull opened
+	if(phase == DrawPhase::Late && frame.recorded && queryPool)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * frameIndex + 1);
+	}
+}
+
+void MeshletRenderer::printOcclusion(std::ostream& out) const
+{
+	gpuTime[0].print(out, "Meshlet GPU time, occlusion culling off", "ms");
+	gpuTime[1].print(out, "Meshlet GPU time, occlusion culling on", "ms");
+	if(totalTested == 0)
+	{
+		return;
+	}
+
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(1) << "Occlusion culled " << 100.0 * totalOccluded / totalTested
+		<< "% of cluster views inside a frustum";
+	if(gpuTime[0].getCount() > 0 && gpuTime[1].getCount() > 0)
+	{
+		out << std::setprecision(3) << ", " << gpuTime[0].mean() - gpuTime[1].mean() << "ms of GPU time saved per frame";
+	}
+	out << std::endl;
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "Camera.h"
+#include "MeshletBuilder.h"
+#include "PipelineLibrary.h"
+#include "Profiler.h"
+#include "VulkanUtil.h"
+
+class JobSystem;
+struct MeshletCandidate;
+
+struct MeshletRendererInfo
+{
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+
+	//Used once for the upload
+	VkQueue queue;
+	VkCommandPool commandPool;
+
+	//The pipelines come from the library, which knows the attachments. Only the depth format is needed here
+	VkFormat depthFormat;
+
+	uint32_t framesInFlight;
+
+	//Without it every cluster gets its own indirect draw call
+	bool multiDrawIndirect;
+
+	//multiViewport plus viewport index output from the vertex shader. Without it the draws are recorded once per view
+	bool multiViewport;
+};
+
+//The most cameras drawn in one frame, each pipeline is built with this many viewports
+static constexpr uint32_t MAX_RENDER_VIEWS = 6;
+
+//A camera and the part of the target it renders into
+struct RenderView
+{
+	Camera camera;
+	VkViewport viewport;
+	VkRect2D scissor;
+};
+
+//The main pass is split around the depth pyramid: Early clears and draws what was visible last frame,
+//Late loads the result and adds what the pyramid shows was missed
+enum class DrawPhase
+{
+	Early,
+	Late
+};
+
+//Farthest depth over ever coarser 2x2 blocks. Level 0 is half the depth buffer rounded up to a power of two,
+//so every level after it halves exactly. Replaced with the depth buffer, frames in flight may still read the old one
+struct DepthPyramid
+{
+	Image image;
+	std::vector<UniqueImageView> levelViews;
+	VkExtent2D extent{};
+
+	//Sets are freed with their pool
+	UniqueDescriptorPool descriptorPool;
+	std::vector<VkDescriptorSet> reduceSets;
+	VkDescriptorSet cullSet = VK_NULL_HANDLE;
+};
+
+struct MeshletStats
+{
+	uint32_t drawn = 0;
+	uint32_t frustumCulled = 0;
+	uint32_t backfaceCulled = 0;
+	uint64_t trianglesDrawn = 0;
+};
+
+//Picks one LOD cut through the cluster hierarchy per frame and culls it on the CPU. The GPU then culls every
+//cluster per view against the frustum and a depth pyramid and writes the indirect draws. Draw i of view v is
+//instance v, which picks view v's matrix and, with multiViewport, its viewport
+class MeshletRenderer
+{
+private:
+	MeshletRendererInfo info{};
+
+	std::vector<Meshlet> meshlets;
+	uint64_t sourceTriangles = 0;
+
+	//The clusters expanded to plain 32 bit indices, meshlet i starts at firstIndices[i]
+	std::vector<uint32_t> firstIndices;
+	Buffer vertexBuffer;
+	Buffer indexBuffer;
+
+	//The selected clusters, one slice of meshlets.size() per frame in flight, mapped for the lifetime of the renderer
+	Buffer candidateBuffer;
+	MeshletCandidate* candidates = nullptr;
+
+	//Written by the cull shader, per frame in flight and phase one run of commands per view
+	Buffer indirectBuffer;
+
+	//Per-instance vertex data, MAX_RENDER_VIEWS view-projection matrices per frame in flight
+	Buffer viewBuffer;
+	glm::mat4* viewMatrices = nullptr;
+
+	//Whether each cluster was visible to each view at the end of last frame, the early pass draws these
+	Buffer visibilityBuffer;
+
+	//Four counters per frame in flight, see meshlet_cull.comp
+	Buffer statsBuffer;
+	const uint32_t* statsCounters = nullptr;
+
+	//Pipelines are owned by the library
+	UniquePipelineLayout pipelineLayout;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	//Hi-Z occlusion culling
+	VkImage depthImage = VK_NULL_HANDLE;
+	UniqueSampler pyramidSampler;
+	UniqueDescriptorSetLayout reduceSetLayout;
+	UniqueDescriptorSetLayout cullSetLayout;
+	UniquePipelineLayout reduceLayout;
+	UniquePipelineLayout cullLayout;
+	VkPipeline reducePipeline = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	DepthPyramid pyramid;
+
+	//Two timestamps per frame in flight around everything the meshlets record
+	UniqueQueryPool queryPool;
+	float timestampPeriod = 0.0f;
+
+	//Set when a frame records its culling, whether occlusion was on, and cleared when its results are read
+	struct PendingResults
+	{
+		bool recorded = false;
+		bool occlusion = false;
+	};
+	std::vector<PendingResults> pending;
+
+	//GPU time of the meshlet work per frame, with occlusion culling off and on
+	Histogram gpuTime[2]{ Histogram(0.02, 500), Histogram(0.02, 500) };
+	uint64_t totalTested = 0;
+	uint64_t totalOccluded = 0;
+
+	//Of the cluster views inside a frustum, in the last frame read back
+	float occludedFraction = 0.0f;
+
+	//Written by select(): one result per cluster, then the drawn ones compacted
+	std::vector<uint8_t> selection;
+	std::vector<uint32_t> selected;
+	MeshletStats stats;
+
+	void createOcclusionResources();
+	void createPipelineLayouts();
+	PipelineDesc drawPipelineDesc() const;
+	void recordIndirect(VkCommandBuffer commandBuffer, VkDeviceSize offset, uint32_t count);
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount, uint32_t phase);
+	void recordPyramid(VkCommandBuffer commandBuffer);
+	VkDeviceSize commandOffset(uint32_t frameIndex, DrawPhase phase) const;
+
+public:
+	//Largest error, in pixels, a cluster may show on screen before a finer one replaces it
+	float errorThreshold = 1.0f;
+
+	//Off draws everything in the frustum in the early phase and skips the pyramid
+	bool occlusionCulling = true;
+
+	void initialize(const MeshletRendererInfo& createInfo, const MeshletMesh& mesh);
+
+	//The draw, depth reduce and cull pipelines, for whoever compiles them
+	void addPipelines(std::vector<PipelineDesc>& manifest) const;
+
+	//Picks the pipelines up from the library once they are compiled, recordDraw() has to wait for it
+	void createPipelines(PipelineLibrary& library);
+
+	//After initialize() and after every depth buffer change. The depth image needs sampled usage.
+	//Returns the pyramid it replaces for the caller to retire
+	DepthPyramid setDepthTarget(VkImage image, VkImageView view, VkExtent2D extent);
+
+	//Right after the frame's fence has signaled, picks up the counters and timestamps it left behind
+	void collectResults(uint32_t frameIndex);
+
+	//CPU only, so it can run on the job system while the GPU is still busy with earlier frames.
+	//A cluster is kept when any of the views sees it, at the detail the closest view needs
+	void select(JobSystem& jobs, const RenderView* views, uint32_t viewCount);
+
+	//Fills this frame's slice of the candidate and view buffers, only once its fence has signaled
+	void writeDraws(uint32_t frameIndex, const RenderView* views, uint32_t viewCount);
+
+	//Outside any pass, before the early one
+	void recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount);
+
+	//Between the two passes, with the early pass's depth in DEPTH_STENCIL_ATTACHMENT_OPTIMAL. Builds the pyramid
+	//from it and culls against that, depth is back in the same layout afterwards
+	void recordLateCull(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount);
+
+	//Inside either pass, before anything that doesn't write depth. Leaves the view viewports set
+	void recordDraw(VkCommandBuffer commandBuffer, uint32_t frameIndex, const RenderView* views, uint32_t viewCount, DrawPhase phase);
+
+	//Culled fraction and GPU time with occlusion culling off and on
+	void printOcclusion(std::ostream& out) const;
+
+	const MeshletStats& getStats() const { return stats; }
+	uint64_t getSourceTriangles() const { return sourceTriangles; }
+	float getOccludedFraction() const { return occludedFraction; }
+};
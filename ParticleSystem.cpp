@@ -0,0 +1,387 @@
+#include "ParticleSystem.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+
+//Matches the push constant block in particle.comp
+struct SimulationPushConstants
+{
+	float deltaTime;
+	uint32_t particleCount;
+};
+
+static constexpr uint32_t WORKGROUP_SIZE = 256;
+
+//Strength and softening of the pull towards the centre, must match particle.comp
+static constexpr float GRAVITY = 0.05f;
+static constexpr float SOFTENING = 0.01f;
+
+void ParticleSystem::initialize(const ParticleSystemInfo& createInfo, uint32_t count)
+{
+	info = createInfo;
+	particleCount = count;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = info.computeFamily;
+
+	if(vkCreateCommandPool(info.device, &poolInfo, nullptr, commandPool.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create compute command pool!");
+	}
+
+	createBuffers();
+	createDescriptors();
+	createPipelineLayouts();
+
+	if(isAsync())
+	{
+		computeCommandBuffers.resize(info.framesInFlight);
+		computeFinishedSemaphores.resize(info.framesInFlight);
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = info.framesInFlight;
+
+		if(vkAllocateCommandBuffers(info.device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create compute command buffers!");
+		}
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		for(auto& semaphore : computeFinishedSemaphores)
+		{
+			if(vkCreateSemaphore(info.device, &semaphoreInfo, nullptr, semaphore.put(info.device)) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to create compute semaphore!");
+			}
+		}
+	}
+}
+
+void ParticleSystem::createBuffers()
+{
+	VkDeviceSize size = sizeof(Particle) * particleCount;
+
+	//Shared between both queues instead of transferring ownership every frame
+	std::vector<uint32_t> queueFamilies = { info.graphicsFamily };
+	if(isAsync())
+	{
+		queueFamilies.push_back(info.computeFamily);
+	}
+
+	//Seed a disc of particles in roughly circular orbits, this is the only time the CPU touches them
+	std::vector<Particle> particles(particleCount);
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for(auto& particle : particles)
+	{
+		float radius = 0.1f + 0.8f * std::sqrt(unit(random));
+		float angle = unit(random) * 6.2831853f;
+		float distanceSquared = radius * radius + SOFTENING;
+		float speed = std::sqrt(GRAVITY * radius * radius / (distanceSquared * std::sqrt(distanceSquared)));
+
+		particle.position[0] = std::cos(angle) * radius;
+		particle.position[1] = std::sin(angle) * radius;
+		particle.velocity[0] = -std::sin(angle) * speed;
+		particle.velocity[1] = std::cos(angle) * speed;
+		particle.color[0] = 1.0f - radius;
+		particle.color[1] = 0.3f + 0.4f * unit(random);
+		particle.color[2] = radius;
+		particle.color[3] = 1.0f;
+	}
+
+	VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	particleBuffers[0] = createDeviceLocalBuffer(info.physicalDevice, info.device, info.computeQueue, commandPool,
+		particles.data(), size, usage, queueFamilies);
+	particleBuffers[1] = createBuffer(info.physicalDevice, info.device, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, queueFamilies);
+
+	current = 0;
+}
+
+void ParticleSystem::createDescriptors()
+{
+	VkDescriptorSetLayoutBinding bindings[2]{};
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = bindings;
+
+	if(vkCreateDescriptorSetLayout(info.device, &layoutInfo, nullptr, descriptorSetLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create particle descriptor set layout!");
+	}
+
+	VkDescriptorPoolSize poolSize{};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 4;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 2;
+
+	if(vkCreateDescriptorPool(info.device, &poolInfo, nullptr, descriptorPool.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create particle descriptor pool!");
+	}
+
+	VkDescriptorSetLayout layouts[2] = { descriptorSetLayout, descriptorSetLayout };
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = descriptorPool;
+	allocInfo.descriptorSetCount = 2;
+	allocInfo.pSetLayouts = layouts;
+
+	if(vkAllocateDescriptorSets(info.device, &allocInfo, descriptorSets) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate particle descriptor sets!");
+	}
+
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		VkDescriptorBufferInfo bufferInfos[2]{};
+		bufferInfos[0].buffer = particleBuffers[i].buffer;
+		bufferInfos[0].range = VK_WHOLE_SIZE;
+		bufferInfos[1].buffer = particleBuffers[1 - i].buffer;
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet writes[2]{};
+		for(uint32_t binding = 0; binding < 2; binding++)
+		{
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = descriptorSets[i];
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].pBufferInfo = &bufferInfos[binding];
+		}
+
+		vkUpdateDescriptorSets(info.device, 2, writes, 0, nullptr);
+	}
+}
+
+void ParticleSystem::createPipelineLayouts()
+{
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(SimulationPushConstants);
+
+	VkPipelineLayoutCreateInfo computeLayoutInfo{};
+	computeLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	computeLayoutInfo.setLayoutCount = 1;
+	computeLayoutInfo.pSetLayouts = descriptorSetLayout.address();
+	computeLayoutInfo.pushConstantRangeCount = 1;
+	computeLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if(vkCreatePipelineLayout(info.device, &computeLayoutInfo, nullptr, computePipelineLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create particle compute pipeline layout!");
+	}
+
+	VkPipelineLayoutCreateInfo graphicsLayoutInfo{};
+	graphicsLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+	if(vkCreatePipelineLayout(info.device, &graphicsLayoutInfo, nullptr, graphicsPipelineLayout.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create particle pipeline layout!");
+	}
+}
+
+void ParticleSystem::addPipelines(std::vector<PipelineDesc>& manifest) const
+{
+	PipelineDesc compute{};
+	compute.computeShader = "particle_comp.spv";
+	compute.layout = computePipelineLayout;
+	manifest.push_back(compute);
+
+	PipelineDesc graphics{};
+	graphics.vertexShader = "particle_vert.spv";
+	graphics.fragmentShader = "particle_frag.spv";
+	graphics.layout = graphicsPipelineLayout;
+
+	//Read the particle buffer directly as vertices: position and color
+	VkVertexInputBindingDescription binding{};
+	binding.binding = 0;
+	binding.stride = sizeof(Particle);
+	binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	graphics.bindings = { binding };
+
+	VkVertexInputAttributeDescription attributes[2]{};
+	attributes[0].binding = 0;
+	attributes[0].location = 0;
+	attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+	attributes[0].offset = offsetof(Particle, position);
+	attributes[1].binding = 0;
+	attributes[1].location = 1;
+	attributes[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attributes[1].offset = offsetof(Particle, color);
+	graphics.attributes.assign(attributes, attributes + 2);
+
+	graphics.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+	graphics.cullMode = VK_CULL_MODE_NONE;
+	graphics.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+	//Drawn over everything, depth is left alone
+	graphics.depthTest = false;
+	graphics.depthWrite = false;
+
+	//Additive, overlapping particles glow instead of needing a sort
+	graphics.blend = BlendMode::Additive;
+	manifest.push_back(graphics);
+}
+
+void ParticleSystem::createPipelines(PipelineLibrary& library)
+{
+	std::vector<PipelineDesc> descs;
+	addPipelines(descs);
+	computePipeline = library.get(descs[0]);
+	graphicsPipeline = library.get(descs[1]);
+}
+
+void ParticleSystem::recordDispatch(VkCommandBuffer commandBuffer, float deltaTime)
+{
+	//The previous step's writes must land, and nothing may still be drawing the buffer about to be overwritten.
+	//Vertex input isn't a valid stage on a compute-only queue, the frame fences cover that case instead
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	if(!isAsync())
+	{
+		srcStage |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+	}
+	vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	SimulationPushConstants pushConstants{};
+	pushConstants.deltaTime = deltaTime;
+	pushConstants.particleCount = particleCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayout, 0, 1, &descriptorSets[current], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(commandBuffer, (particleCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	current = 1 - current;
+}
+
+void ParticleSystem::recordUpdate(VkCommandBuffer commandBuffer, float deltaTime)
+{
+	recordDispatch(commandBuffer, deltaTime);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+VkSemaphore ParticleSystem::submitUpdate(uint32_t frameIndex, float deltaTime)
+{
+	VkCommandBuffer commandBuffer = computeCommandBuffers[frameIndex];
+	vkResetCommandBuffer(commandBuffer, 0);
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to start recording compute command buffer!");
+	}
+
+	recordDispatch(commandBuffer, deltaTime);
+
+	if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to end compute command buffer!");
+	}
+
+	//The semaphore wait on the graphics queue makes the writes visible there
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = computeFinishedSemaphores[frameIndex].address();
+
+	if(vkQueueSubmit(info.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit particle update!");
+	}
+
+	return computeFinishedSemaphores[frameIndex];
+}
+
+void ParticleSystem::recordDraw(VkCommandBuffer commandBuffer)
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, particleBuffers[current].buffer.address(), &offset);
+	vkCmdDraw(commandBuffer, particleCount, 1, 0, 0);
+}
+
+double ParticleSystem::measureUpdateRate(uint32_t iterations)
+{
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if(vkAllocateCommandBuffers(info.device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create benchmark command buffer!");
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	for(uint32_t i = 0; i < iterations; i++)
+	{
+		recordDispatch(commandBuffer, 1.0f / 60.0f);
+	}
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	auto start = std::chrono::steady_clock::now();
+	if(vkQueueSubmit(info.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit particle benchmark!");
+	}
+	vkQueueWaitIdle(info.computeQueue);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	vkFreeCommandBuffers(info.device, commandPool, 1, &commandBuffer);
+
+	return static_cast<double>(particleCount) * iterations / elapsed.count();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "PipelineLibrary.h"
+#include "VulkanUtil.h"
+
+//Matches the Particle struct in particle.comp, std430 layout
+struct Particle
+{
+	float position[2];
+	float velocity[2];
+	float color[4];
+};
+
+struct ParticleSystemInfo
+{
+	VkPhysicalDevice physicalDevice;
+	VkDevice device;
+
+	uint32_t graphicsFamily;
+	uint32_t computeFamily;
+	VkQueue computeQueue;
+
+	uint32_t framesInFlight;
+};
+
+//Integrates particles on the GPU, ping-ponging between two storage buffers, and draws the result as points
+class ParticleSystem
+{
+private:
+	ParticleSystemInfo info{};
+	uint32_t particleCount = 0;
+
+	//Whichever buffer the last update wrote, and therefore the one that gets drawn
+	uint32_t current = 0;
+	Buffer particleBuffers[2];
+
+	UniqueDescriptorSetLayout descriptorSetLayout;
+	UniqueDescriptorPool descriptorPool;
+
+	//descriptorSets[i] reads particleBuffers[i] and writes the other one
+	VkDescriptorSet descriptorSets[2];
+
+	//Pipelines are owned by the library
+	UniquePipelineLayout computePipelineLayout;
+	VkPipeline computePipeline = VK_NULL_HANDLE;
+	UniquePipelineLayout graphicsPipelineLayout;
+	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+
+	//Owned by the compute family, used for the upload and for async updates
+	UniqueCommandPool commandPool;
+	std::vector<VkCommandBuffer> computeCommandBuffers;
+	std::vector<UniqueSemaphore> computeFinishedSemaphores;
+
+	void createBuffers();
+	void createDescriptors();
+	void createPipelineLayouts();
+	void recordDispatch(VkCommandBuffer commandBuffer, float deltaTime);
+
+public:
+	//Everything is owned by handles and freed when the system goes, the device must be idle by then
+	void initialize(const ParticleSystemInfo& createInfo, uint32_t count);
+
+	//The simulation and draw pipelines, for whoever compiles them
+	void addPipelines(std::vector<PipelineDesc>& manifest) const;
+
+	//Picks both pipelines up from the library once they are compiled. Nothing below may be called until it has
+	void createPipelines(PipelineLibrary& library);
+
+	uint32_t getParticleCount() const { return particleCount; }
+
+	//A separate compute family runs the simulation on its own queue alongside graphics
+	bool isAsync() const { return info.computeFamily != info.graphicsFamily; }
+
+	//Same queue: records the step into the frame's command buffer, outside any render pass
+	void recordUpdate(VkCommandBuffer commandBuffer, float deltaTime);
+
+	//Async: submits the step to the compute queue, graphics must wait on the returned semaphore at vertex input
+	VkSemaphore submitUpdate(uint32_t frameIndex, float deltaTime);
+
+	//Inside the render pass, after the update for this frame
+	void recordDraw(VkCommandBuffer commandBuffer);
+
+	//Runs back to back updates on the compute queue and returns particles updated per second
+	double measureUpdateRate(uint32_t iterations);
+};
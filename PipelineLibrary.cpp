@@ -0,0 +1,366 @@
+#include "PipelineLibrary.h"
+#include "JobSystem.h"
+#include "VulkanUtil.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+static void hashCombine(size_t& seed, size_t value)
+{
+	seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+static bool operator==(const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b)
+{
+	return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+}
+
+static bool operator==(const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b)
+{
+	return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const
+{
+	return vertexShader == other.vertexShader && fragmentShader == other.fragmentShader && computeShader == other.computeShader
+		&& specialization == other.specialization && layout == other.layout
+		&& bindings == other.bindings && attributes == other.attributes
+		&& topology == other.topology && viewportCount == other.viewportCount
+		&& cullMode == other.cullMode && frontFace == other.frontFace
+		&& depthTest == other.depthTest && depthWrite == other.depthWrite && depthCompare == other.depthCompare
+		&& blend == other.blend;
+}
+
+size_t PipelineDescHash::operator()(const PipelineDesc& desc) const
+{
+	size_t seed = std::hash<std::string>()(desc.vertexShader);
+	hashCombine(seed, std::hash<std::string>()(desc.fragmentShader));
+	hashCombine(seed, std::hash<std::string>()(desc.computeShader));
+	for(uint32_t value : desc.specialization)
+	{
+		hashCombine(seed, value);
+	}
+	hashCombine(seed, std::hash<VkPipelineLayout>()(desc.layout));
+	for(const VkVertexInputBindingDescription& binding : desc.bindings)
+	{
+		hashCombine(seed, binding.binding);
+		hashCombine(seed, binding.stride);
+		hashCombine(seed, binding.inputRate);
+	}
+	for(const VkVertexInputAttributeDescription& attribute : desc.attributes)
+	{
+		hashCombine(seed, attribute.location);
+		hashCombine(seed, attribute.binding);
+		hashCombine(seed, attribute.format);
+		hashCombine(seed, attribute.offset);
+	}
+	hashCombine(seed, desc.topology);
+	hashCombine(seed, desc.viewportCount);
+	hashCombine(seed, desc.cullMode);
+	hashCombine(seed, desc.frontFace);
+	hashCombine(seed, desc.depthTest);
+	hashCombine(seed, desc.depthWrite);
+	hashCombine(seed, desc.depthCompare);
+	hashCombine(seed, static_cast<size_t>(desc.blend));
+	return seed;
+}
+
+void PipelineLibrary::initialize(const PipelineLibraryInfo& createInfo)
+{
+	info = createInfo;
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if(vkCreatePipelineCache(info.device, &cacheInfo, nullptr, pipelineCache.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline cache!");
+	}
+}
+
+void PipelineLibrary::addShader(const std::string& name, const std::vector<char>& code)
+{
+	UniqueShaderModule module = createShaderModule(info.device, code);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	shaders.try_emplace(name, std::move(module));
+}
+
+VkShaderModule PipelineLibrary::findShader(const std::string& name)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = shaders.find(name);
+		if(found != shaders.end())
+		{
+			return found->second;
+		}
+	}
+
+	//Read without the lock, if another thread got there first its module is kept and this one dropped
+	UniqueShaderModule module = createShaderModule(info.device, readFile(name));
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return shaders.try_emplace(name, std::move(module)).first->second;
+}
+
+void PipelineLibrary::findShaders(const PipelineDesc& desc, VkShaderModule modules[2])
+{
+	if(!desc.computeShader.empty())
+	{
+		modules[0] = findShader(desc.computeShader);
+		modules[1] = VK_NULL_HANDLE;
+		return;
+	}
+
+	modules[0] = findShader(desc.vertexShader);
+	modules[1] = findShader(desc.fragmentShader);
+}
+
+//Constant i sits at offset 4 * i. The returned info points into entries, which has to outlive it
+static VkSpecializationInfo specializationInfo(const std::vector<uint32_t>& values, std::vector<VkSpecializationMapEntry>& entries)
+{
+	entries.resize(values.size());
+	for(uint32_t i = 0; i < entries.size(); i++)
+	{
+		entries[i].constantID = i;
+		entries[i].offset = sizeof(uint32_t) * i;
+		entries[i].size = sizeof(uint32_t);
+	}
+
+	VkSpecializationInfo info{};
+	info.mapEntryCount = static_cast<uint32_t>(entries.size());
+	info.pMapEntries = entries.data();
+	info.dataSize = sizeof(uint32_t) * values.size();
+	info.pData = values.data();
+	return info;
+}
+
+UniquePipeline PipelineLibrary::compile(const PipelineDesc& desc, const VkShaderModule modules[2]) const
+{
+	if(!desc.computeShader.empty())
+	{
+		return compileCompute(desc, modules[0]);
+	}
+	return compileGraphics(desc, modules[0], modules[1]);
+}
+
+UniquePipeline PipelineLibrary::compileCompute(const PipelineDesc& desc, VkShaderModule computeModule) const
+{
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	VkSpecializationInfo specialization = specializationInfo(desc.specialization, specializationEntries);
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = computeModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = desc.specialization.empty() ? nullptr : &specialization;
+	pipelineInfo.layout = desc.layout;
+
+	UniquePipeline pipeline;
+	if(vkCreateComputePipelines(info.device, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create compute pipeline from " + desc.computeShader + "!");
+	}
+	return pipeline;
+}
+
+UniquePipeline PipelineLibrary::compileGraphics(const PipelineDesc& desc, VkShaderModule vertModule, VkShaderModule fragModule) const
+{
+	//The same constants go to both stages
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	VkSpecializationInfo specialization = specializationInfo(desc.specialization, specializationEntries);
+
+	VkPipelineShaderStageCreateInfo shaderStages[2]{};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragModule;
+	shaderStages[1].pName = "main";
+	if(!desc.specialization.empty())
+	{
+		shaderStages[0].pSpecializationInfo = &specialization;
+		shaderStages[1].pSpecializationInfo = &specialization;
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.bindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.attributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+
+	//Viewport and scissor are dynamic, only their counts are baked in. This also keeps the swapchain extent,
+	//which may be worked out on another thread, out of the pipeline
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = desc.viewportCount;
+	viewportState.scissorCount = desc.viewportCount;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = desc.frontFace;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	multisampling.minSampleShading = 1.0f;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = desc.depthCompare;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	if(desc.blend == BlendMode::Additive)
+	{
+		colorBlendAttachment.blendEnable = VK_TRUE;
+		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	}
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	//Without a render pass the pipeline just needs the attachment formats
+	VkPipelineRenderingCreateInfo pipelineRenderingInfo{};
+	pipelineRenderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	pipelineRenderingInfo.colorAttachmentCount = 1;
+	pipelineRenderingInfo.pColorAttachmentFormats = &info.colorFormat;
+	pipelineRenderingInfo.depthAttachmentFormat = info.depthFormat;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = info.renderPass == VK_NULL_HANDLE ? &pipelineRenderingInfo : nullptr;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = info.renderPass;
+	pipelineInfo.subpass = 0;
+	pipelineInfo.basePipelineIndex = -1;
+
+	UniquePipeline pipeline;
+	if(vkCreateGraphicsPipelines(info.device, pipelineCache, 1, &pipelineInfo, nullptr, pipeline.put(info.device)) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create graphics pipeline from " + desc.vertexShader + " and " + desc.fragmentShader + "!");
+	}
+	return pipeline;
+}
+
+std::vector<const PipelineDesc*> PipelineLibrary::findMissing(const std::vector<PipelineDesc>& manifest)
+{
+	//Manifests are short, a linear search for repeats within one is plenty
+	std::vector<const PipelineDesc*> missing;
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const PipelineDesc& desc : manifest)
+	{
+		bool repeated = std::any_of(missing.begin(), missing.end(), [&desc](const PipelineDesc* other) { return *other == desc; });
+		if(repeated || pipelines.count(desc) > 0)
+		{
+			duplicates.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		missing.push_back(&desc);
+	}
+	return missing;
+}
+
+void PipelineLibrary::insert(const std::vector<const PipelineDesc*>& missing, std::vector<UniquePipeline>& compiled)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for(size_t i = 0; i < missing.size(); i++)
+	{
+		pipelines.try_emplace(*missing[i], std::move(compiled[i]));
+	}
+	precompiled.fetch_add(static_cast<uint32_t>(missing.size()), std::memory_order_relaxed);
+}
+
+void PipelineLibrary::precompile(JobSystem& jobs, const std::vector<PipelineDesc>& manifest)
+{
+	//Only what is new gets a job
+	std::vector<const PipelineDesc*> missing = findMissing(manifest);
+
+	//Modules first, the compile jobs only read them
+	uint32_t count = static_cast<uint32_t>(missing.size());
+	std::vector<VkShaderModule> modules(count * 2);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		findShaders(*missing[i], &modules[i * 2]);
+	}
+
+	std::vector<UniquePipeline> compiled(count);
+	jobs.parallelFor(count, 1, [this, &missing, &modules, &compiled](uint32_t begin, uint32_t end)
+	{
+		for(uint32_t i = begin; i < end; i++)
+		{
+			compiled[i] = compile(*missing[i], &modules[i * 2]);
+		}
+	});
+
+	insert(missing, compiled);
+}
+
+VkPipeline PipelineLibrary::get(const PipelineDesc& desc)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = pipelines.find(desc);
+		if(found != pipelines.end())
+		{
+			return found->second;
+		}
+	}
+
+	//Missing from the manifest. Compiled without the lock so other lookups carry on meanwhile
+	lateCompiles.fetch_add(1, std::memory_order_relaxed);
+	VkShaderModule modules[2];
+	findShaders(desc, modules);
+	UniquePipeline pipeline = compile(desc, modules);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return pipelines.try_emplace(desc, std::move(pipeline)).first->second;
+}
+
+size_t PipelineLibrary::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return pipelines.size();
+}
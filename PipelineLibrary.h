@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanHandle.h"
+
+class JobSystem;
+
+enum class BlendMode : uint32_t
+{
+	Opaque,
+	Additive
+};
+
+//Everything one pipeline differs from another in. Viewport and scissor are always dynamic,
+//the attachments come from the library
+struct PipelineDesc
+{
+	//By file name, the library keeps one module per file
+	std::string vertexShader;
+	std::string fragmentShader;
+
+	//Set instead of the two above for a compute pipeline, which only uses the specialization and layout as well
+	std::string computeShader;
+
+	//constant_id i gets specialization[i] in both stages, ids a stage doesn't declare are ignored
+	std::vector<uint32_t> specialization;
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	std::vector<VkVertexInputBindingDescription> bindings;
+	std::vector<VkVertexInputAttributeDescription> attributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	uint32_t viewportCount = 1;
+
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	bool depthTest = false;
+	bool depthWrite = false;
+	VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+	BlendMode blend = BlendMode::Opaque;
+
+	bool operator==(const PipelineDesc& other) const;
+};
+
+struct PipelineDescHash
+{
+	size_t operator()(const PipelineDesc& desc) const;
+};
+
+struct PipelineLibraryInfo
+{
+	VkDevice device;
+
+	//renderPass is VK_NULL_HANDLE on the dynamic rendering path, the formats are used instead
+	VkRenderPass renderPass;
+	VkFormat colorFormat;
+	VkFormat depthFormat;
+};
+
+//Compiled pipelines keyed by their description, so asking for the same state twice hands back the same
+//pipeline. Startup precompiles a manifest of every variant the app knows it will use, anything else that
+//shows up later is compiled on the spot and counted, since that is a hitch in the middle of a frame
+class PipelineLibrary
+{
+private:
+	PipelineLibraryInfo info{};
+
+	//Shared by every compile, it is internally synchronized
+	UniquePipelineCache pipelineCache;
+
+	//Guards both maps, compiles themselves run outside it
+	std::mutex mutex;
+	std::unordered_map<std::string, UniqueShaderModule> shaders;
+	std::unordered_map<PipelineDesc, UniquePipeline, PipelineDescHash> pipelines;
+
+	//Written under the mutex, read without it from whichever thread reports them
+	std::atomic<uint32_t> precompiled{ 0 };
+	std::atomic<uint32_t> duplicates{ 0 };
+	std::atomic<uint32_t> lateCompiles{ 0 };
+
+	VkShaderModule findShader(const std::string& name);
+
+	//Vertex and fragment module, or the compute module and VK_NULL_HANDLE
+	void findShaders(const PipelineDesc& desc, VkShaderModule modules[2]);
+
+	UniquePipeline compile(const PipelineDesc& desc, const VkShaderModule modules[2]) const;
+	UniquePipeline compileGraphics(const PipelineDesc& desc, VkShaderModule vertModule, VkShaderModule fragModule) const;
+	UniquePipeline compileCompute(const PipelineDesc& desc, VkShaderModule computeModule) const;
+
+	//What precompile has to build, with duplicates folded, and where it puts the results
+	std::vector<const PipelineDesc*> findMissing(const std::vector<PipelineDesc>& manifest);
+	void insert(const std::vector<const PipelineDesc*>& missing, std::vector<UniquePipeline>& compiled);
+
+public:
+	void initialize(const PipelineLibraryInfo& createInfo);
+
+	//Code that was already read, e.g. on another job. Files nobody added are read on first use
+	void addShader(const std::string& name, const std::vector<char>& code);
+
+	//Compiles every description not in the library yet, one job each. Duplicates in the manifest are folded
+	void precompile(JobSystem& jobs, const std::vector<PipelineDesc>& manifest);
+
+	//Owned by the library. Thread safe, but compiles on a miss
+	VkPipeline get(const PipelineDesc& desc);
+
+	size_t size();
+	uint32_t getPrecompiled() const { return precompiled.load(std::memory_order_relaxed); }
+	uint32_t getDuplicates() const { return duplicates.load(std::memory_order_relaxed); }
+	uint32_t getLateCompiles() const { return lateCompiles.load(std::memory_order_relaxed); }
+};
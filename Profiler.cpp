@@ -0,0 +1,169 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <unordered_map>
+
+Histogram::Histogram(double bucketWidth, uint32_t bucketCount)
+	: bucketWidth(bucketWidth), buckets(bucketCount, 0)
+{
+}
+
+void Histogram::add(double value)
+{
+	if(count == 0)
+	{
+		min = value;
+		max = value;
+	}
+	min = std::min(min, value);
+	max = std::max(max, value);
+	sum += value;
+	count++;
+
+	size_t bucket = static_cast<size_t>(std::max(value, 0.0) / bucketWidth);
+	if(bucket < buckets.size())
+	{
+		buckets[bucket]++;
+	}
+	else
+	{
+		overflow++;
+	}
+}
+
+void Histogram::clear()
+{
+	std::fill(buckets.begin(), buckets.end(), 0);
+	overflow = 0;
+	count = 0;
+	sum = 0.0;
+	min = 0.0;
+	max = 0.0;
+}
+
+double Histogram::percentile(double fraction) const
+{
+	uint64_t target = static_cast<uint64_t>(fraction * count);
+	uint64_t seen = 0;
+	for(size_t i = 0; i < buckets.size(); i++)
+	{
+		seen += buckets[i];
+		if(seen > target)
+		{
+			return (i + 1) * bucketWidth;
+		}
+	}
+	return max;
+}
+
+void Histogram::print(std::ostream& out, const std::string& name, const std::string& unit) const
+{
+	out << name << ": " << count << " samples";
+	if(count == 0)
+	{
+		out << std::endl;
+		return;
+	}
+
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(2)
+		<< ", min " << min << unit
+		<< ", mean " << mean() << unit
+		<< ", p50 " << percentile(0.50) << unit
+		<< ", p95 " << percentile(0.95) << unit
+		<< ", p99 " << percentile(0.99) << unit
+		<< ", max " << max << unit << std::endl;
+
+	//Squash the occupied range into at most 16 rows so it fits in a terminal
+	size_t first = std::min(static_cast<size_t>(min / bucketWidth), buckets.size() - 1);
+	size_t last = std::min(static_cast<size_t>(max / bucketWidth), buckets.size() - 1);
+	size_t bucketsPerRow = (last - first) / 16 + 1;
+
+	for(size_t row = first; row <= last; row += bucketsPerRow)
+	{
+		uint32_t rowCount = 0;
+		for(size_t i = row; i < std::min(row + bucketsPerRow, buckets.size()); i++)
+		{
+			rowCount += buckets[i];
+		}
+
+		size_t barLength = static_cast<size_t>(40.0 * rowCount / count + 0.5);
+		out << "  " << std::setw(8) << row * bucketWidth << unit << " | " << std::string(barLength, '#') << " " << rowCount << std::endl;
+	}
+
+	if(overflow > 0)
+	{
+		out << "  " << std::setw(8) << buckets.size() * bucketWidth << unit << "+| " << overflow << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
+
+Timeline::Timeline()
+	: origin(std::chrono::steady_clock::now())
+{
+}
+
+void Timeline::restart()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	origin = std::chrono::steady_clock::now();
+	spans.clear();
+}
+
+double Timeline::now() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void Timeline::record(const std::string& name, double begin, double end)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	spans.push_back({ name, begin, end, std::this_thread::get_id() });
+}
+
+void Timeline::print(std::ostream& out, const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::vector<Span> sorted = spans;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+
+	double total = 0.0;
+	size_t nameWidth = 0;
+	for(const Span& span : sorted)
+	{
+		total = std::max(total, span.end);
+		nameWidth = std::max(nameWidth, span.name.size());
+	}
+
+	std::ios_base::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+
+	out << std::fixed << std::setprecision(1) << name << ": " << total << "ms" << std::endl;
+
+	std::unordered_map<std::thread::id, uint32_t> threads;
+	for(const Span& span : sorted)
+	{
+		uint32_t thread = threads.emplace(span.thread, static_cast<uint32_t>(threads.size())).first->second;
+
+		//40 columns for the whole run, every span gets at least one
+		size_t first = total > 0.0 ? static_cast<size_t>(40.0 * span.begin / total) : 0;
+		size_t last = total > 0.0 ? static_cast<size_t>(40.0 * span.end / total) : 0;
+		first = std::min<size_t>(first, 39);
+		last = std::max(std::min<size_t>(last, 40), first + 1);
+
+		out << "  " << std::left << std::setw(static_cast<int>(nameWidth)) << span.name << std::right
+			<< " T" << thread
+			<< " " << std::setw(8) << span.begin << " - " << std::setw(8) << span.end << "ms"
+			<< " |" << std::string(first, ' ') << std::string(last - first, '#') << std::string(40 - last, ' ') << "| "
+			<< std::max(0.0, span.end - span.begin) << "ms" << std::endl;
+	}
+
+	out.flags(flags);
+	out.precision(precision);
+}
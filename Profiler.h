@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Fixed-width buckets, anything past the last bucket is counted as overflow
+class Histogram
+{
+private:
+	double bucketWidth;
+	std::vector<uint32_t> buckets;
+	uint32_t overflow = 0;
+
+	uint32_t count = 0;
+	double sum = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+
+public:
+	explicit Histogram(double bucketWidth = 0.25, uint32_t bucketCount = 400);
+
+	void add(double value);
+	void clear();
+
+	uint32_t getCount() const { return count; }
+	double mean() const { return count > 0 ? sum / count : 0.0; }
+
+	//Upper edge of the bucket holding the given fraction of samples
+	double percentile(double fraction) const;
+
+	void print(std::ostream& out, const std::string& name, const std::string& unit) const;
+};
+
+//Named spans in milliseconds since construction, recorded from any thread
+class Timeline
+{
+private:
+	struct Span
+	{
+		std::string name;
+		double begin;
+		double end;
+		std::thread::id thread;
+	};
+
+	std::chrono::steady_clock::time_point origin;
+	std::mutex mutex;
+	std::vector<Span> spans;
+
+public:
+	Timeline();
+
+	void restart();
+	double now() const;
+
+	void record(const std::string& name, double begin, double end);
+
+	template<typename Function>
+	void measure(const std::string& name, Function&& function)
+	{
+		double begin = now();
+		function();
+		record(name, begin, now());
+	}
+
+	//One row per span in start order, with a bar showing where it sits. Threads are numbered by first appearance
+	void print(std::ostream& out, const std::string& name);
+};
@@ -0,0 +1,94 @@
+#include "Scene.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <random>
+
+Scene::Scene(uint32_t objectCount)
+{
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> position(-WORLD_EXTENT, WORLD_EXTENT);
+	std::uniform_real_distribution<float> velocity(-0.3f, 0.3f);
+	std::uniform_real_distribution<float> spin(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> scale(0.03f, 0.12f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	//Triangle and quad, see the position table in shader.vert
+	meshes = {
+		{ 0, 3 },
+		{ 3, 6 }
+	};
+
+	const uint32_t materialCount = 8;
+	for(uint32_t i = 0; i < materialCount; i++)
+	{
+		materials.push_back({ glm::vec4(unit(random), unit(random), unit(random), 1.0f) });
+	}
+
+	std::uniform_int_distribution<uint32_t> material(0, materialCount - 1);
+	std::uniform_int_distribution<uint32_t> mesh(0, static_cast<uint32_t>(meshes.size()) - 1);
+
+	objects.resize(objectCount);
+	for(auto& object : objects)
+	{
+		object.position = { position(random), position(random) };
+		object.velocity = { velocity(random), velocity(random) };
+		object.rotation = 0.0f;
+		object.angularVelocity = spin(random);
+		object.scale = scale(random);
+		object.depth = unit(random);
+
+		//A quarter of the objects glow
+		object.pipeline = unit(random) < 0.25f ? PIPELINE_ADDITIVE : PIPELINE_OPAQUE;
+		object.material = material(random);
+		object.mesh = mesh(random);
+	}
+
+	visibility.resize(objectCount);
+	visibleObjects.reserve(objectCount);
+}
+
+void Scene::update(JobSystem& jobs, float deltaTime)
+{
+	jobs.parallelFor(static_cast<uint32_t>(objects.size()), 256, [this, deltaTime](uint32_t begin, uint32_t end)
+	{
+		for(uint32_t i = begin; i < end; i++)
+		{
+			SceneObject& object = objects[i];
+			object.position += object.velocity * deltaTime;
+			object.rotation = std::fmod(object.rotation + object.angularVelocity * deltaTime, 6.2831853f);
+
+			//Bounce off the edges of the world
+			for(int axis = 0; axis < 2; axis++)
+			{
+				if(std::abs(object.position[axis]) > WORLD_EXTENT)
+				{
+					object.position[axis] = std::copysign(WORLD_EXTENT, object.position[axis]);
+					object.velocity[axis] = -object.velocity[axis];
+				}
+			}
+		}
+	});
+}
+
+void Scene::cull(JobSystem& jobs)
+{
+	jobs.parallelFor(static_cast<uint32_t>(objects.size()), 256, [this](uint32_t begin, uint32_t end)
+	{
+		for(uint32_t i = begin; i < end; i++)
+		{
+			//Bounding circle against clip space [-1, 1]
+			const SceneObject& object = objects[i];
+			visibility[i] = std::abs(object.position.x) - object.scale <= 1.0f && std::abs(object.position.y) - object.scale <= 1.0f;
+		}
+	});
+
+	visibleObjects.clear();
+	for(uint32_t i = 0; i < visibility.size(); i++)
+	{
+		if(visibility[i])
+		{
+			visibleObjects.push_back(i);
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+//Indices into Application::graphicsPipelines, one row each in SPRITE_VARIANTS
+enum PipelineId : uint32_t
+{
+	PIPELINE_OPAQUE,
+	PIPELINE_ADDITIVE,
+	PIPELINE_COUNT
+};
+
+struct Material
+{
+	glm::vec4 tint;
+};
+
+//Range of the vertex arrays baked into shader.vert
+struct Mesh
+{
+	uint32_t firstVertex;
+	uint32_t vertexCount;
+};
+
+struct SceneObject
+{
+	glm::vec2 position;
+	glm::vec2 velocity;
+	float rotation;
+	float angularVelocity;
+	float scale;
+	float depth;
+
+	uint32_t pipeline;
+	uint32_t material;
+	uint32_t mesh;
+};
+
+//Per-instance vertex input of shader.vert
+struct InstanceData
+{
+	glm::vec2 offset;
+	float scale;
+	float rotation;
+};
+
+//Matches the push constant block in shader.frag
+struct MaterialPushConstants
+{
+	glm::vec4 tint;
+};
+
+class Scene
+{
+private:
+	std::vector<SceneObject> objects;
+	std::vector<Material> materials;
+	std::vector<Mesh> meshes;
+
+	//One flag per object written by cull(), compacted into visibleObjects afterwards
+	std::vector<uint8_t> visibility;
+	std::vector<uint32_t> visibleObjects;
+
+public:
+	explicit Scene(uint32_t objectCount);
+
+	//Objects wander a bit past the edges of the screen so culling has something to do
+	static constexpr float WORLD_EXTENT = 1.5f;
+
+	void update(JobSystem& jobs, float deltaTime);
+	void cull(JobSystem& jobs);
+
+	const std::vector<SceneObject>& getObjects() const { return objects; }
+	const std::vector<Material>& getMaterials() const { return materials; }
+	const std::vector<Mesh>& getMeshes() const { return meshes; }
+	const std::vector<uint32_t>& getVisibleObjects() const { return visibleObjects; }
+};
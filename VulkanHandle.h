@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <utility>
+
+//Move-only owner of a handle that is created from, and destroyed through, a parent instance or device.
+//Destroy is the matching vkDestroy*/vkFree* entry point, called as Destroy(parent, handle, nullptr)
+template<typename Parent, typename Handle, auto Destroy>
+class UniqueHandle
+{
+private:
+	Parent parent = VK_NULL_HANDLE;
+	Handle handle = VK_NULL_HANDLE;
+
+public:
+	UniqueHandle() = default;
+	UniqueHandle(Parent parent, Handle handle) : parent(parent), handle(handle) {}
+	~UniqueHandle() { reset(); }
+
+	UniqueHandle(const UniqueHandle&) = delete;
+	UniqueHandle& operator=(const UniqueHandle&) = delete;
+
+	UniqueHandle(UniqueHandle&& other) noexcept
+		: parent(other.parent), handle(std::exchange(other.handle, VK_NULL_HANDLE))
+	{
+	}
+
+	UniqueHandle& operator=(UniqueHandle&& other) noexcept
+	{
+		if(this != &other)
+		{
+			reset();
+			parent = other.parent;
+			handle = std::exchange(other.handle, VK_NULL_HANDLE);
+		}
+		return *this;
+	}
+
+	void reset()
+	{
+		if(handle != VK_NULL_HANDLE)
+		{
+			Destroy(parent, handle, nullptr);
+			handle = VK_NULL_HANDLE;
+		}
+	}
+
+	//Frees what is held and hands the slot to a vkCreate* call, e.g. vkCreateFence(device, &info, nullptr, fence.put(device))
+	Handle* put(Parent owner)
+	{
+		reset();
+		parent = owner;
+		return &handle;
+	}
+
+	Handle get() const { return handle; }
+
+	//For the calls that take arrays of handles
+	const Handle* address() const { return &handle; }
+
+	operator Handle() const { return handle; }
+	explicit operator bool() const { return handle != VK_NULL_HANDLE; }
+};
+
+//Same for the instance and the device themselves, which have no parent
+template<typename Handle, auto Destroy>
+class UniqueRoot
+{
+private:
+	Handle handle = VK_NULL_HANDLE;
+
+public:
+	UniqueRoot() = default;
+	~UniqueRoot() { reset(); }
+
+	UniqueRoot(const UniqueRoot&) = delete;
+	UniqueRoot& operator=(const UniqueRoot&) = delete;
+
+	UniqueRoot(UniqueRoot&& other) noexcept : handle(std::exchange(other.handle, VK_NULL_HANDLE)) {}
+
+	UniqueRoot& operator=(UniqueRoot&& other) noexcept
+	{
+		if(this != &other)
+		{
+			reset();
+			handle = std::exchange(other.handle, VK_NULL_HANDLE);
+		}
+		return *this;
+	}
+
+	void reset()
+	{
+		if(handle != VK_NULL_HANDLE)
+		{
+			Destroy(handle, nullptr);
+			handle = VK_NULL_HANDLE;
+		}
+	}
+
+	Handle* put()
+	{
+		reset();
+		return &handle;
+	}
+
+	Handle get() const { return handle; }
+	operator Handle() const { return handle; }
+	explicit operator bool() const { return handle != VK_NULL_HANDLE; }
+};
+
+//Extension entry point, the loader doesn't export it
+inline void destroyDebugMessenger(VkInstance instance, VkDebugUtilsMessengerEXT messenger, const VkAllocationCallbacks* allocator)
+{
+	auto func = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+	if(func != nullptr)
+	{
+		func(instance, messenger, allocator);
+	}
+}
+
+//The device does not wait for itself, whoever owns it has to call vkDeviceWaitIdle before its children go
+using UniqueInstance = UniqueRoot<VkInstance, vkDestroyInstance>;
+using UniqueDevice = UniqueRoot<VkDevice, vkDestroyDevice>;
+
+using UniqueSurface = UniqueHandle<VkInstance, VkSurfaceKHR, vkDestroySurfaceKHR>;
+using UniqueDebugMessenger = UniqueHandle<VkInstance, VkDebugUtilsMessengerEXT, destroyDebugMessenger>;
+
+template<typename Handle, auto Destroy>
+using DeviceHandle = UniqueHandle<VkDevice, Handle, Destroy>;
+
+using UniqueSwapchain = DeviceHandle<VkSwapchainKHR, vkDestroySwapchainKHR>;
+using UniqueBuffer = DeviceHandle<VkBuffer, vkDestroyBuffer>;
+using UniqueDeviceMemory = DeviceHandle<VkDeviceMemory, vkFreeMemory>;
+using UniqueImage = DeviceHandle<VkImage, vkDestroyImage>;
+using UniqueImageView = DeviceHandle<VkImageView, vkDestroyImageView>;
+using UniqueSampler = DeviceHandle<VkSampler, vkDestroySampler>;
+using UniqueFramebuffer = DeviceHandle<VkFramebuffer, vkDestroyFramebuffer>;
+using UniqueRenderPass = DeviceHandle<VkRenderPass, vkDestroyRenderPass>;
+using UniqueShaderModule = DeviceHandle<VkShaderModule, vkDestroyShaderModule>;
+using UniquePipelineLayout = DeviceHandle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using UniquePipeline = DeviceHandle<VkPipeline, vkDestroyPipeline>;
+using UniquePipelineCache = DeviceHandle<VkPipelineCache, vkDestroyPipelineCache>;
+using UniqueDescriptorSetLayout = DeviceHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
+using UniqueDescriptorPool = DeviceHandle<VkDescriptorPool, vkDestroyDescriptorPool>;
+using UniqueCommandPool = DeviceHandle<VkCommandPool, vkDestroyCommandPool>;
+using UniqueSemaphore = DeviceHandle<VkSemaphore, vkDestroySemaphore>;
+using UniqueFence = DeviceHandle<VkFence, vkDestroyFence>;
+using UniqueQueryPool = DeviceHandle<VkQueryPool, vkDestroyQueryPool>;
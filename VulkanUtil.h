@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+#include "VulkanHandle.h"
+
+//Members go in reverse destruction order, the memory is freed after whatever is bound to it
+struct Buffer
+{
+	UniqueDeviceMemory memory;
+	UniqueBuffer buffer;
+	VkDeviceSize size = 0;
+
+	//Only set for host visible buffers
+	void* mapped = nullptr;
+};
+
+struct Image
+{
+	UniqueDeviceMemory memory;
+	UniqueImage image;
+	UniqueImageView view;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+};
+
+std::vector<char> readFile(const std::string& filename);
+
+UniqueShaderModule createShaderModule(VkDevice device, const std::vector<char>& code);
+
+uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+//Host visible buffers come back persistently mapped. More than one queue family makes the buffer concurrent
+Buffer createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize size, VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags properties, const std::vector<uint32_t>& queueFamilies = {});
+
+//Device local copy of data, uploaded through a staging buffer and waited on before returning
+Buffer createDeviceLocalBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool,
+	const void* data, VkDeviceSize size, VkBufferUsageFlags usage, const std::vector<uint32_t>& queueFamilies = {});
+
+//Single layer 2D image with a view covering every mip
+Image createImage(VkPhysicalDevice physicalDevice, VkDevice device, VkExtent2D extent, VkFormat format,
+	VkImageUsageFlags usage, VkImageAspectFlags aspect, uint32_t mipLevels = 1);
+
+//First of the candidates usable as an optimal tiling depth attachment that shaders can also sample
+VkFormat findDepthFormat(VkPhysicalDevice physicalDevice);
+
+//Layout transitions of a depth image have to name its stencil aspect too when the format has one
+VkImageAspectFlags depthAspects(VkFormat format);
@@ -2,9 +2,32 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/vec4.hpp>
 #include <iostream>
+#include <string>
 #include "Application.h"
+#include "Benchmark.h"
+#include "JobSystem.h"
+#include "MeshletBuilder.h"
 
-int main() {
+int main(int argc, char** argv) {
+
+	if(argc > 1 && std::string(argv[1]) == "--bench")
+	{
+		runBenchmarks();
+		return EXIT_SUCCESS;
+	}
+
+	if(argc > 1 && std::string(argv[1]) == "--build-meshlets")
+	{
+		JobSystem jobs;
+		MeshletMesh mesh = buildDemoMeshletMesh(jobs);
+		if(!saveMeshletMesh(DEMO_MESHLET_FILE, mesh))
+		{
+			std::cout << "Unable to write file: " << DEMO_MESHLET_FILE << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << "Wrote " << mesh.meshlets.size() << " clusters over " << mesh.levelCount << " levels to " << DEMO_MESHLET_FILE << std::endl;
+		return EXIT_SUCCESS;
+	}
 
 	Application app {};
 
@@ -0,0 +1,11 @@
+#version 450
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 0) out vec4 outColor;
+
+const vec3 LIGHT_DIRECTION = normalize(vec3(0.4, 0.3, 0.85));
+
+void main() {
+	float diffuse = max(dot(normalize(fragNormal), LIGHT_DIRECTION), 0.0);
+	outColor = vec4(vec3(0.15 + 0.85 * diffuse) * vec3(0.8, 0.85, 0.9), 1.0);
+}
\ No newline at end of file
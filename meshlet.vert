@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+//Per instance, the camera of the view being drawn
+layout(location = 2) in mat4 viewProjection;
+
+layout(location = 0) out vec3 fragNormal;
+
+void main() {
+	gl_Position = viewProjection * vec4(position, 1.0);
+	fragNormal = normal;
+}
\ No newline at end of file
@@ -3,6 +3,18 @@
 layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
+layout(push_constant) uniform MaterialPushConstants {
+	vec4 tint;
+} material;
+
+//Set per pipeline variant, see SPRITE_VARIANTS in Application.cpp. The untaken branch is compiled out
+layout(constant_id = 0) const bool ADDITIVE = false;
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
+	//Additive blending ignores alpha, so it scales the glow instead
+	if(ADDITIVE) {
+		outColor = vec4(fragColor * material.tint.rgb * material.tint.a, 1.0);
+	} else {
+		outColor = vec4(fragColor, 1.0) * material.tint;
+	}
 }
\ No newline at end of file
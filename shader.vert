@@ -1,20 +1,41 @@
 #version 450
 
+layout(location = 0) in vec4 instance; // xy = offset, z = scale, w = rotation
+
 layout(location = 0) out vec3 fragColor;
 
-vec2 positions[3] = vec2[](
+//Triangle at 0, quad at 3
+vec2 positions[9] = vec2[](
 	vec2(0.0, -0.5),
 	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
+	vec2(-0.5, 0.5),
+
+	vec2(-0.5, -0.5),
+	vec2(0.5, -0.5),
+	vec2(0.5, 0.5),
+	vec2(0.5, 0.5),
+	vec2(-0.5, 0.5),
+	vec2(-0.5, -0.5)
 );
 
-vec3 colors[3] = vec3[](
+vec3 colors[9] = vec3[](
     vec3(1.0, 0.0, 0.0),
     vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
+    vec3(0.0, 0.0, 1.0),
+
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, 0.0),
+    vec3(0.0, 1.0, 1.0),
+    vec3(0.0, 1.0, 1.0),
+    vec3(1.0, 0.0, 1.0),
+    vec3(1.0, 1.0, 1.0)
 );
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+	float s = sin(instance.w);
+	float c = cos(instance.w);
+	vec2 position = mat2(c, s, -s, c) * positions[gl_VertexIndex] * instance.z;
+
+	gl_Position = vec4(position + instance.xy, 0.0, 1.0);
 	fragColor = colors[gl_VertexIndex];
 }
\ No newline at end of file